@@ -0,0 +1,219 @@
+#pragma once
+// 多反应堆模型：每个核心运行一个event_base，各自通过SO_REUSEPORT监听同一端口，由内核在各个循环之间分发连接；
+// 计算哈希、压缩、fsync等耗时的磁盘操作交给独立的工作线程池，完成后再回到所属的事件循环中发送响应
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <atomic>
+#include <iostream>
+#include <functional>
+#include <cstring>
+#include <pthread.h>
+#include <sched.h>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <event2/event.h>
+#include <event2/http.h>
+#include <event2/thread.h>
+#include <event2/util.h>
+#include "../log_system/logs_code/ThreadPoll.hpp"
+
+namespace storage {
+    using HttpHandler = std::function<void(evhttp_request*)>;
+
+    // 单个事件循环，独占一个线程并可绑定到指定核心
+    class EventLoop {
+        public:
+            using ptr = std::shared_ptr<EventLoop>;
+            using Task = std::function<void()>;
+            EventLoop(int index, int cpu) : index_(index), cpu_(cpu) {
+                base_ = event_base_new();
+                http_ = evhttp_new(base_);
+                // 其他线程投递任务后激活该事件，唤醒循环执行任务
+                notify_ = event_new(base_, -1, EV_PERSIST, &EventLoop::OnNotify, this);
+                event_add(notify_, nullptr);
+            }
+
+            ~EventLoop() {
+                Stop();
+                if(listen_fd_ >= 0) close(listen_fd_);
+                event_free(notify_);
+                evhttp_free(http_);
+                event_base_free(base_);
+            }
+
+            // 创建本循环独立的监听套接字，多个循环通过SO_REUSEPORT监听同一个地址
+            bool Listen(const std::string &addr, uint16_t port) {
+                listen_fd_ = socket(AF_INET, SOCK_STREAM, 0);
+                if(listen_fd_ < 0) {
+                    std::cout << __FILE__ << __LINE__ << "create socket failed: " << strerror(errno) << std::endl;
+                    return false;
+                }
+                int on = 1;
+                setsockopt(listen_fd_, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+                if(setsockopt(listen_fd_, SOL_SOCKET, SO_REUSEPORT, &on, sizeof(on)) < 0) {
+                    std::cout << __FILE__ << __LINE__ << "set SO_REUSEPORT failed: " << strerror(errno) << std::endl;
+                    return false;
+                }
+                struct sockaddr_in server;
+                memset(&server, 0, sizeof(server));
+                server.sin_family = AF_INET;
+                server.sin_port = htons(port);
+                inet_aton(addr.c_str(), &(server.sin_addr));
+                if(bind(listen_fd_, (struct sockaddr*)&server, sizeof(server)) < 0 ||
+                   listen(listen_fd_, 1024) < 0) {
+                    std::cout << __FILE__ << __LINE__ << "bind/listen failed: " << strerror(errno) << std::endl;
+                    return false;
+                }
+                evutil_make_socket_nonblocking(listen_fd_);
+                return evhttp_accept_socket(http_, listen_fd_) == 0;
+            }
+
+            void SetHandler(const HttpHandler &handler) {
+                handler_ = handler;
+                evhttp_set_gencb(http_, &EventLoop::OnRequest, this);
+            }
+
+            void Start() {
+                thread_ = std::thread([this]() {
+                    BindCpu();
+                    event_base_dispatch(base_);
+                });
+            }
+
+            void Stop() {
+                if(!thread_.joinable()) return;
+                event_base_loopbreak(base_);
+                thread_.join();
+            }
+
+            // 线程安全：把任务投递到本循环所在线程执行
+            void RunInLoop(Task task) {
+                {
+                    std::unique_lock<std::mutex> lock(mtx_);
+                    pending_.emplace_back(std::move(task));
+                }
+                event_active(notify_, EV_READ, 0);
+            }
+
+            int Index() const { return index_; }
+            event_base *Base() { return base_; }
+            evhttp *Http() { return http_; }
+
+        private:
+            void BindCpu() {
+                if(cpu_ < 0) return;
+                cpu_set_t set;
+                CPU_ZERO(&set);
+                CPU_SET(cpu_, &set);
+                if(pthread_setaffinity_np(pthread_self(), sizeof(set), &set) != 0) {
+                    std::cout << __FILE__ << __LINE__ << "bind cpu " << cpu_ << " failed" << std::endl;
+                }
+            }
+
+            static void OnRequest(evhttp_request *req, void *arg) {
+                static_cast<EventLoop*>(arg)->handler_(req);
+            }
+
+            static void OnNotify(evutil_socket_t, short, void *arg) {
+                auto *loop = static_cast<EventLoop*>(arg);
+                std::vector<Task> tasks;
+                {
+                    std::unique_lock<std::mutex> lock(loop->mtx_);
+                    tasks.swap(loop->pending_);
+                }
+                for(auto &t : tasks) t();
+            }
+
+        private:
+            int index_;
+            int cpu_; // 绑定的核心，-1表示不绑定
+            int listen_fd_ = -1;
+            event_base *base_ = nullptr;
+            evhttp *http_ = nullptr;
+            event *notify_ = nullptr;
+            HttpHandler handler_;
+            std::mutex mtx_;
+            std::vector<Task> pending_; // 其他线程投递过来的任务
+            std::thread thread_;
+    };
+
+    // 事件循环组，管理N个事件循环和一个处理磁盘操作的工作线程池
+    class EventLoopGroup {
+        public:
+            // loop_count为0时使用全部核心
+            EventLoopGroup(size_t loop_count, size_t worker_count, bool pin_cpu = true) {
+                evthread_use_pthreads(); // RunInLoop需要跨线程激活事件
+                size_t ncpu = std::thread::hardware_concurrency();
+                if(ncpu == 0) ncpu = 1;
+                if(loop_count == 0) loop_count = ncpu;
+                for(size_t i = 0; i < loop_count; i++) {
+                    loops_.emplace_back(std::make_shared<EventLoop>(i, pin_cpu ? static_cast<int>(i % ncpu) : -1));
+                }
+                workers_.reset(new ThreadPool(worker_count));
+            }
+
+            ~EventLoopGroup() {
+                Stop();
+            }
+
+            bool Listen(const std::string &addr, uint16_t port) {
+                for(auto &loop : loops_) {
+                    if(!loop->Listen(addr, port)) return false;
+                }
+                return true;
+            }
+
+            // 所有循环共用同一个请求处理函数
+            void SetHandler(const HttpHandler &handler) {
+                for(auto &loop : loops_) {
+                    loop->SetHandler(handler);
+                }
+            }
+
+            void Start() {
+                for(auto &loop : loops_) {
+                    loop->Start();
+                }
+            }
+
+            void Stop() {
+                for(auto &loop : loops_) {
+                    loop->Stop();
+                }
+            }
+
+            // 在工作线程池中执行耗时的任务，完成后回到请求所在的事件循环执行done，
+            // evhttp_request只能在其所属循环的线程中使用，所以发送响应必须放在done中
+            void Offload(const EventLoop::ptr &loop, std::function<void()> task, std::function<void()> done) {
+                try {
+                    workers_->enqueue([loop, task, done]() {
+                        task();
+                        loop->RunInLoop(done);
+                    });
+                }
+                catch (const std::runtime_error &e) {
+                    std::cout << __FILE__ << __LINE__ << "thread pool closed" << std::endl;
+                }
+            }
+
+            // 根据event_base找到请求所属的事件循环
+            EventLoop::ptr LoopOf(evhttp_request *req) {
+                event_base *base = evhttp_connection_get_base(evhttp_request_get_connection(req));
+                for(auto &loop : loops_) {
+                    if(loop->Base() == base) return loop;
+                }
+                return EventLoop::ptr();
+            }
+
+            size_t Size() const { return loops_.size(); }
+
+        private:
+            std::vector<EventLoop::ptr> loops_;
+            std::unique_ptr<ThreadPool> workers_; // 处理哈希、压缩、fsync等磁盘操作
+    };
+}
@@ -0,0 +1,302 @@
+#pragma once
+// 热点小文件缓存：把体积小、下载频繁的文件连同预先构造好的响应头保存在内存中，
+// 命中时直接以引用方式挂到evbuffer上发送，省去每次请求的open/stat/sendfile系统调用
+#include <list>
+#include <mutex>
+#include <string>
+#include <vector>
+#include <memory>
+#include <atomic>
+#include <cstdint>
+#include <algorithm>
+#include <utility>
+#include <unordered_map>
+#include <event2/buffer.h>
+#include <event2/http.h>
+#include <event2/keyvalq_struct.h>
+
+namespace storage {
+    // 缓存对象，body通过shared_ptr引用计数，被evbuffer引用期间即使已被淘汰也不会释放
+    struct CacheObject {
+        using ptr = std::shared_ptr<const CacheObject>;
+        std::vector<std::pair<std::string, std::string>> headers; // 预先构造好的响应头
+        std::shared_ptr<const std::string> body; // 文件内容
+    };
+
+    // 对外导出的统计信息
+    struct CacheStats {
+        size_t hits = 0;
+        size_t misses = 0;
+        size_t inserts = 0;
+        size_t evictions = 0;
+        size_t invalidations = 0;
+        size_t stale_puts = 0; // 读取期间被失效而放弃的Put
+        size_t objects = 0;
+        size_t used_bytes = 0;
+        size_t max_bytes = 0;
+
+        double HitRatio() const {
+            size_t total = hits + misses;
+            return total == 0 ? 0.0 : static_cast<double>(hits) / total;
+        }
+    };
+
+    // 淘汰策略采用S3-FIFO：新对象先进入小队列(约10%容量)，只被访问一次的对象很快被淘汰并记入幽灵队列，
+    // 被多次访问的对象晋升到主队列；幽灵队列中再次出现的key直接进入主队列。
+    // 相比LRU，一次性的大范围扫描不会把真正的热点对象冲掉
+    class HotCache {
+        public:
+            using ptr = std::shared_ptr<HotCache>;
+            HotCache(size_t max_bytes, size_t max_object_size)
+                : max_bytes_(max_bytes),
+                  small_max_bytes_(max_bytes / 10),
+                  max_object_size_(max_object_size) {}
+
+            // 文件大小是否适合放入缓存
+            bool Cacheable(size_t size) const {
+                return enabled_ && size <= max_object_size_;
+            }
+
+            // 查找缓存对象，未命中返回空指针
+            CacheObject::ptr Lookup(const std::string &key) {
+                if(!enabled_) return CacheObject::ptr();
+                std::unique_lock<std::mutex> lock(mtx_);
+                auto it = index_.find(key);
+                if(it == index_.end()) {
+                    ++misses_;
+                    return CacheObject::ptr();
+                }
+                ++hits_;
+                Entry &e = *(it->second);
+                if(e.freq < 3) ++e.freq; // 命中只增加访问计数，不移动节点
+                return e.obj;
+            }
+
+            // 未命中后读取文件之前调用，取得的版本号交给Put，用于发现读取期间发生的Invalidate
+            uint64_t Generation() {
+                std::unique_lock<std::mutex> lock(mtx_);
+                return gen_;
+            }
+
+            // 放入缓存，已存在则替换；gen为读取文件前Generation()的返回值，
+            // 读取期间该key被Invalidate过时说明读到的可能是旧内容，放弃放入
+            void Put(const std::string &key, uint64_t gen, std::string &&body,
+                     std::vector<std::pair<std::string, std::string>> headers) {
+                if(!Cacheable(body.size())) return;
+                auto obj = std::make_shared<CacheObject>();
+                obj->headers = std::move(headers);
+                obj->body = std::make_shared<const std::string>(std::move(body));
+                size_t charge = Charge(key, *obj);
+
+                std::unique_lock<std::mutex> lock(mtx_);
+                if(gen < floor_gen_) {
+                    ++stale_puts_;
+                    return;
+                }
+                auto inv = invalidated_.find(key);
+                if(inv != invalidated_.end() && inv->second > gen) {
+                    ++stale_puts_;
+                    return;
+                }
+                EraseLocked(key);
+                Entry e;
+                e.key = key;
+                e.obj = obj;
+                e.charge = charge;
+                // 幽灵队列中出现过的key说明近期被访问过，直接进入主队列
+                auto g = ghost_index_.find(key);
+                if(g != ghost_index_.end()) {
+                    ghost_.erase(g->second);
+                    ghost_index_.erase(g);
+                    e.in_main = true;
+                    main_.push_front(std::move(e));
+                    index_[key] = main_.begin();
+                    main_bytes_ += charge;
+                } else {
+                    small_.push_front(std::move(e));
+                    index_[key] = small_.begin();
+                    small_bytes_ += charge;
+                }
+                ++inserts_;
+                while(small_bytes_ + main_bytes_ > max_bytes_) {
+                    EvictLocked();
+                }
+            }
+
+            // 上传覆盖或删除文件时调用，使缓存失效
+            void Invalidate(const std::string &key) {
+                std::unique_lock<std::mutex> lock(mtx_);
+                ++gen_;
+                // 记录每个key最近一次失效的版本号；记录过多时整体清空，并拒绝清空前取得版本号的所有Put
+                if(invalidated_.size() >= kMaxInvalidated) {
+                    invalidated_.clear();
+                    floor_gen_ = gen_;
+                }
+                invalidated_[key] = gen_;
+                if(EraseLocked(key)) ++invalidations_;
+            }
+
+            // 运行时开关缓存，关闭时清空所有对象，便于对比开启和关闭时的性能
+            void SetEnabled(bool enabled) {
+                std::unique_lock<std::mutex> lock(mtx_);
+                enabled_ = enabled;
+                if(!enabled) {
+                    small_.clear();
+                    main_.clear();
+                    ghost_.clear();
+                    index_.clear();
+                    ghost_index_.clear();
+                    small_bytes_ = main_bytes_ = 0;
+                }
+            }
+
+            CacheStats Stats() {
+                std::unique_lock<std::mutex> lock(mtx_);
+                CacheStats s;
+                s.hits = hits_;
+                s.misses = misses_;
+                s.inserts = inserts_;
+                s.evictions = evictions_;
+                s.invalidations = invalidations_;
+                s.stale_puts = stale_puts_;
+                s.objects = index_.size();
+                s.used_bytes = small_bytes_ + main_bytes_;
+                s.max_bytes = max_bytes_;
+                return s;
+            }
+
+            // 把缓存对象写入响应：响应头直接拷贝，文件内容以引用方式挂到evbuffer，不发生拷贝
+            static void AttachTo(evhttp_request *req, const CacheObject::ptr &obj) {
+                evkeyvalq *out_headers = evhttp_request_get_output_headers(req);
+                for(auto &h : obj->headers) {
+                    evhttp_add_header(out_headers, h.first.c_str(), h.second.c_str());
+                }
+                evbuffer *buf = evhttp_request_get_output_buffer(req);
+                // 持有一份shared_ptr，evbuffer发送完毕后在回调中释放
+                auto *pin = new std::shared_ptr<const std::string>(obj->body);
+                if(evbuffer_add_reference(buf, (*pin)->data(), (*pin)->size(), ReleasePin, pin) != 0) {
+                    delete pin;
+                    evbuffer_add(buf, obj->body->data(), obj->body->size());
+                }
+            }
+
+        private:
+            struct Entry {
+                std::string key;
+                CacheObject::ptr obj;
+                size_t charge = 0; // 占用内存
+                int freq = 0; // 访问计数，最大为3
+                bool in_main = false;
+            };
+            using EntryList = std::list<Entry>;
+            static const size_t kMaxInvalidated = 4096; // 失效记录的数量上限
+
+            static void ReleasePin(const void *, size_t, void *arg) {
+                delete static_cast<std::shared_ptr<const std::string>*>(arg);
+            }
+
+            static size_t Charge(const std::string &key, const CacheObject &obj) {
+                size_t charge = key.size() + obj.body->size() + sizeof(Entry);
+                for(auto &h : obj.headers) {
+                    charge += h.first.size() + h.second.size();
+                }
+                return charge;
+            }
+
+            bool EraseLocked(const std::string &key) {
+                auto it = index_.find(key);
+                if(it == index_.end()) return false;
+                auto node = it->second;
+                if(node->in_main) {
+                    main_bytes_ -= node->charge;
+                    main_.erase(node);
+                } else {
+                    small_bytes_ -= node->charge;
+                    small_.erase(node);
+                }
+                index_.erase(it);
+                return true;
+            }
+
+            void EvictLocked() {
+                if(small_bytes_ > small_max_bytes_ || main_.empty()) {
+                    EvictSmall();
+                } else {
+                    EvictMain();
+                }
+            }
+
+            // 小队列尾部对象：被访问过则晋升到主队列，否则淘汰并记入幽灵队列
+            void EvictSmall() {
+                while(!small_.empty()) {
+                    auto tail = std::prev(small_.end());
+                    small_bytes_ -= tail->charge;
+                    if(tail->freq > 1) {
+                        tail->freq = 0;
+                        tail->in_main = true;
+                        main_bytes_ += tail->charge;
+                        main_.splice(main_.begin(), small_, tail);
+                        if(main_bytes_ > max_bytes_ - small_max_bytes_) EvictMain();
+                        continue;
+                    }
+                    AddGhost(tail->key);
+                    index_.erase(tail->key);
+                    small_.erase(tail);
+                    ++evictions_;
+                    return;
+                }
+                EvictMain();
+            }
+
+            // 主队列尾部对象：访问计数不为0则计数减一后重新插入头部，否则淘汰
+            void EvictMain() {
+                while(!main_.empty()) {
+                    auto tail = std::prev(main_.end());
+                    if(tail->freq > 0) {
+                        --tail->freq;
+                        main_.splice(main_.begin(), main_, tail);
+                        continue;
+                    }
+                    main_bytes_ -= tail->charge;
+                    index_.erase(tail->key);
+                    main_.erase(tail);
+                    ++evictions_;
+                    return;
+                }
+            }
+
+            // 幽灵队列只保存key，数量与主队列对象数相当
+            void AddGhost(const std::string &key) {
+                ghost_.push_front(key);
+                ghost_index_[key] = ghost_.begin();
+                size_t limit = std::max<size_t>(main_.size(), 1024);
+                while(ghost_.size() > limit) {
+                    ghost_index_.erase(ghost_.back());
+                    ghost_.pop_back();
+                }
+            }
+
+        private:
+            std::mutex mtx_;
+            std::atomic<bool> enabled_{true};
+            size_t max_bytes_; // 缓存总容量
+            size_t small_max_bytes_; // 小队列容量
+            size_t max_object_size_; // 可缓存的单个文件大小上限
+            size_t small_bytes_ = 0;
+            size_t main_bytes_ = 0;
+            EntryList small_; // 小队列
+            EntryList main_; // 主队列
+            std::list<std::string> ghost_; // 幽灵队列
+            std::unordered_map<std::string, EntryList::iterator> index_;
+            std::unordered_map<std::string, std::list<std::string>::iterator> ghost_index_;
+            size_t hits_ = 0;
+            size_t misses_ = 0;
+            size_t inserts_ = 0;
+            size_t evictions_ = 0;
+            size_t invalidations_ = 0;
+            size_t stale_puts_ = 0;
+            uint64_t gen_ = 0; // 每次Invalidate加一
+            uint64_t floor_gen_ = 0; // 小于该值的版本号一律视为过期
+            std::unordered_map<std::string, uint64_t> invalidated_; // key最近一次失效时的版本号
+    };
+}
@@ -0,0 +1,316 @@
+#pragma once
+// 按客户端和等级(tier)限制带宽与请求速率，避免少数批量下载的客户端挤占交互式用户
+// 客户端带宽：同一客户端的所有连接加入同一个libevent rate-limit group，由事件循环按令牌桶节流写出
+// 请求速率、等级总带宽：请求进入时检查令牌桶，超出则直接返回429
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <chrono>
+#include <algorithm>
+#include <unordered_map>
+#include <event2/event.h>
+#include <event2/http.h>
+#include <event2/bufferevent.h>
+#include "../log_system/logs_code/Mylog.hpp"
+
+namespace storage {
+    // 令牌桶，rate为每秒补充的令牌数，burst为桶容量
+    class TokenBucket {
+        public:
+            // 第一次设置时桶是满的，新客户端的第一批请求不会被拒绝；之后重新配置只保留现有令牌
+            void SetRate(double rate, double burst) {
+                Refill();
+                rate_ = rate;
+                burst_ = burst;
+                tokens_ = configured_ ? std::min(tokens_, burst_) : burst_;
+                configured_ = true;
+            }
+
+            // 令牌足够则扣除并返回true
+            bool Consume(double n) {
+                Refill();
+                if(tokens_ < n) return false;
+                tokens_ -= n;
+                return true;
+            }
+
+            // 无条件扣除，允许欠账，用于响应发出后按实际字节数计费
+            void Charge(double n) {
+                Refill();
+                tokens_ -= n;
+            }
+
+            bool InDebt() {
+                Refill();
+                return tokens_ < 0;
+            }
+
+        private:
+            void Refill() {
+                auto now = std::chrono::steady_clock::now();
+                double elapsed = std::chrono::duration<double>(now - last_).count();
+                last_ = now;
+                tokens_ = std::min(burst_, tokens_ + elapsed * rate_);
+            }
+
+        private:
+            double rate_ = 0;
+            double burst_ = 0;
+            double tokens_ = 0;
+            bool configured_ = false;
+            std::chrono::steady_clock::time_point last_ = std::chrono::steady_clock::now();
+    };
+
+    // 某个等级的限流参数
+    struct TierLimit {
+        size_t client_bytes_per_sec = 0; // 单个客户端带宽，0表示不限制
+        size_t client_requests_per_sec = 0; // 单个客户端请求速率
+        size_t tier_bytes_per_sec = 0; // 整个等级的总带宽
+        size_t tier_requests_per_sec = 0; // 整个等级的总请求速率
+    };
+
+    // 限流统计信息
+    struct ThrottleStats {
+        size_t admitted = 0;
+        size_t client_request_throttled = 0;
+        size_t tier_request_throttled = 0;
+        size_t tier_bytes_throttled = 0;
+    };
+
+    class RateLimiter {
+        public:
+            // base用于驱动客户端rate-limit group的定时器，多反应堆时各个循环的连接都可以加入
+            RateLimiter(const std::string &conf_path, event_base *base)
+                : conf_path_(conf_path), base_(base) {
+                Reload();
+            }
+
+            ~RateLimiter() {
+                for(auto &c : clients_) {
+                    if(c.second.group) bufferevent_rate_limit_group_free(c.second.group);
+                }
+            }
+
+            // 重新读取配置文件，修改后的限额立即对已有连接生效，无需重启
+            bool Reload() {
+                std::string content;
+                mylog::Util::File file;
+                if(file.GetContent(&content, conf_path_) == false) {
+                    std::cout << __FILE__ << __LINE__ << "open " << conf_path_ << " failed" << std::endl;
+                    return false;
+                }
+                Json::Value root;
+                if(!mylog::Util::JsonUtil::UnSerialize(content, &root)) return false;
+
+                std::unordered_map<std::string, TierLimit> tiers;
+                Json::Value tiers_val = root["tiers"];
+                for(auto &name : tiers_val.getMemberNames()) {
+                    Json::Value t = tiers_val[name];
+                    TierLimit limit;
+                    limit.client_bytes_per_sec = t["client_bytes_per_sec"].asUInt64();
+                    limit.client_requests_per_sec = t["client_requests_per_sec"].asUInt64();
+                    limit.tier_bytes_per_sec = t["tier_bytes_per_sec"].asUInt64();
+                    limit.tier_requests_per_sec = t["tier_requests_per_sec"].asUInt64();
+                    tiers[name] = limit;
+                }
+                std::unordered_map<std::string, std::string> client_tiers;
+                Json::Value clients_val = root["clients"];
+                for(auto &ip : clients_val.getMemberNames()) {
+                    client_tiers[ip] = clients_val[ip].asString();
+                }
+
+                std::unique_lock<std::mutex> lock(mtx_);
+                tiers_.swap(tiers);
+                client_tiers_.swap(client_tiers);
+                default_tier_ = root["default_tier"].asString();
+                log_sample_ = std::max<size_t>(1, root["log_sample"].asUInt64());
+                // 已有的桶和group按新配置调整速率
+                for(auto &t : tier_states_) {
+                    ApplyTierLocked(t.first, t.second);
+                }
+                for(auto &c : clients_) {
+                    ApplyClientLocked(c.first, c.second);
+                }
+                return true;
+            }
+
+            // 请求入口处调用，返回false表示请求已被限流并回复了429，调用者不应再处理该请求
+            bool Admit(evhttp_request *req) {
+                evhttp_connection *evcon = evhttp_request_get_connection(req);
+                char *peer_addr = nullptr;
+                uint16_t peer_port = 0;
+                evhttp_connection_get_peer(evcon, &peer_addr, &peer_port);
+                std::string ip = peer_addr ? peer_addr : "";
+
+                const char *reason = nullptr;
+                size_t log_sample = 1;
+                {
+                    std::unique_lock<std::mutex> lock(mtx_);
+                    ClientState &client = ClientLocked(ip);
+                    TierState &tier = TierLocked(client.tier);
+                    client.last_active = std::chrono::steady_clock::now();
+                    if(client.limit.client_requests_per_sec && !client.requests.Consume(1)) {
+                        reason = "client request rate";
+                        ++stats_.client_request_throttled;
+                    } else if(tier.limit.tier_requests_per_sec && !tier.requests.Consume(1)) {
+                        reason = "tier request rate";
+                        ++stats_.tier_request_throttled;
+                    } else if(tier.limit.tier_bytes_per_sec && tier.bytes.InDebt()) {
+                        reason = "tier bandwidth";
+                        ++stats_.tier_bytes_throttled;
+                    } else {
+                        ++stats_.admitted;
+                        // 连接首次请求时加入客户端的rate-limit group，由事件循环对写出进行节流
+                        bufferevent *bev = evhttp_connection_get_bufferevent(evcon);
+                        if(client.group && bev && joined_.emplace(bev, ip).second) {
+                            ++client.connections;
+                            bufferevent_add_to_rate_limit_group(bev, client.group);
+                            evhttp_connection_set_closecb(evcon, &RateLimiter::OnClose, this);
+                        }
+                    }
+                    log_sample = log_sample_;
+                }
+                if(reason == nullptr) return true;
+
+                // 限流事件按采样率记录日志，避免日志本身成为负担
+                if(throttle_count_.fetch_add(1) % log_sample == 0) {
+                    auto logger = mylog::GetLogger("asynclogger");
+                    if(!logger) logger = mylog::DefaultLogger();
+                    logger->Warn("client %s throttled by %s, total throttled %lu",
+                                 ip.c_str(), reason, (unsigned long)throttle_count_.load());
+                }
+                evhttp_add_header(evhttp_request_get_output_headers(req), "Retry-After", "1");
+                evhttp_send_reply(req, 429, "Too Many Requests", nullptr);
+                return false;
+            }
+
+            // 响应发送后按实际字节数给等级总带宽计费
+            void ChargeBytes(evhttp_request *req, size_t bytes) {
+                evhttp_connection *evcon = evhttp_request_get_connection(req);
+                char *peer_addr = nullptr;
+                uint16_t peer_port = 0;
+                evhttp_connection_get_peer(evcon, &peer_addr, &peer_port);
+                std::unique_lock<std::mutex> lock(mtx_);
+                ClientState &client = ClientLocked(peer_addr ? peer_addr : "");
+                TierState &tier = TierLocked(client.tier);
+                if(tier.limit.tier_bytes_per_sec) tier.bytes.Charge(bytes);
+            }
+
+            ThrottleStats Stats() {
+                std::unique_lock<std::mutex> lock(mtx_);
+                return stats_;
+            }
+
+        private:
+            struct TierState {
+                TierLimit limit;
+                TokenBucket requests;
+                TokenBucket bytes;
+            };
+
+            struct ClientState {
+                std::string tier;
+                TierLimit limit;
+                TokenBucket requests;
+                bufferevent_rate_limit_group *group = nullptr; // 该客户端所有连接共享的带宽限制
+                size_t connections = 0;
+                std::chrono::steady_clock::time_point last_active;
+            };
+
+            const std::string &TierOfLocked(const std::string &ip) {
+                auto it = client_tiers_.find(ip);
+                return it == client_tiers_.end() ? default_tier_ : it->second;
+            }
+
+            TierLimit LimitOfLocked(const std::string &tier) {
+                auto it = tiers_.find(tier);
+                return it == tiers_.end() ? TierLimit() : it->second;
+            }
+
+            TierState &TierLocked(const std::string &tier) {
+                auto it = tier_states_.find(tier);
+                if(it == tier_states_.end()) {
+                    it = tier_states_.emplace(tier, TierState()).first;
+                    ApplyTierLocked(tier, it->second);
+                }
+                return it->second;
+            }
+
+            ClientState &ClientLocked(const std::string &ip) {
+                auto it = clients_.find(ip);
+                if(it == clients_.end()) {
+                    SweepIdleLocked();
+                    it = clients_.emplace(ip, ClientState()).first;
+                    ApplyClientLocked(ip, it->second);
+                }
+                return it->second;
+            }
+
+            void ApplyTierLocked(const std::string &tier, TierState &state) {
+                state.limit = LimitOfLocked(tier);
+                state.requests.SetRate(state.limit.tier_requests_per_sec, state.limit.tier_requests_per_sec);
+                state.bytes.SetRate(state.limit.tier_bytes_per_sec, state.limit.tier_bytes_per_sec);
+            }
+
+            void ApplyClientLocked(const std::string &ip, ClientState &state) {
+                state.tier = TierOfLocked(ip);
+                state.limit = LimitOfLocked(state.tier);
+                state.requests.SetRate(state.limit.client_requests_per_sec, state.limit.client_requests_per_sec);
+                if(state.limit.client_bytes_per_sec == 0) {
+                    // 不限带宽时保留已有的group，只把速率调到足够大，避免已加入的连接悬空
+                    if(state.group == nullptr) return;
+                }
+                size_t rate = state.limit.client_bytes_per_sec ? state.limit.client_bytes_per_sec : EV_RATE_LIMIT_MAX;
+                ev_token_bucket_cfg *cfg = ev_token_bucket_cfg_new(
+                    EV_RATE_LIMIT_MAX, EV_RATE_LIMIT_MAX, rate, rate, nullptr);
+                if(state.group == nullptr) {
+                    state.group = bufferevent_rate_limit_group_new(base_, cfg);
+                } else {
+                    bufferevent_rate_limit_group_set_cfg(state.group, cfg); // group内部会拷贝一份配置
+                }
+                ev_token_bucket_cfg_free(cfg);
+            }
+
+            // 清理长时间没有请求且没有连接的客户端，防止map无限增长
+            void SweepIdleLocked() {
+                if(clients_.size() < 4096) return;
+                auto now = std::chrono::steady_clock::now();
+                for(auto it = clients_.begin(); it != clients_.end();) {
+                    if(it->second.connections == 0 && now - it->second.last_active > std::chrono::minutes(5)) {
+                        if(it->second.group) bufferevent_rate_limit_group_free(it->second.group);
+                        it = clients_.erase(it);
+                    } else {
+                        ++it;
+                    }
+                }
+            }
+
+            static void OnClose(evhttp_connection *evcon, void *arg) {
+                auto *self = static_cast<RateLimiter*>(arg);
+                std::unique_lock<std::mutex> lock(self->mtx_);
+                auto it = self->joined_.find(evhttp_connection_get_bufferevent(evcon));
+                if(it == self->joined_.end()) return;
+                auto client = self->clients_.find(it->second);
+                if(client != self->clients_.end() && client->second.connections > 0) {
+                    --client->second.connections;
+                }
+                self->joined_.erase(it);
+            }
+
+        private:
+            std::string conf_path_;
+            event_base *base_;
+            std::mutex mtx_;
+            std::string default_tier_;
+            std::unordered_map<std::string, TierLimit> tiers_; // 等级名 -> 限额
+            std::unordered_map<std::string, std::string> client_tiers_; // 客户端ip -> 等级名
+            std::unordered_map<std::string, TierState> tier_states_;
+            std::unordered_map<std::string, ClientState> clients_;
+            std::unordered_map<bufferevent*, std::string> joined_; // 已加入rate-limit group的连接 -> 客户端ip
+            ThrottleStats stats_;
+            size_t log_sample_ = 100; // 每多少次限流事件记录一条日志
+            std::atomic<size_t> throttle_count_{0};
+    };
+}
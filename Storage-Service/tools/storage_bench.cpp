@@ -0,0 +1,244 @@
+// 存储服务下载路径的压测工具：用EventLoopGroup在本机回环地址上启动HTTP服务，
+// 处理GET /download/<文件名>，可选用HotCache缓存小文件；客户端线程用长连接反复下载，统计每秒请求数。
+// 可以一次给出多个事件循环数量，依次测试，用于比较循环数量和缓存开关对吞吐的影响。
+// 编译: g++ -O2 -std=c++11 storage_bench.cpp -I.. -levent -levent_pthreads -pthread -o storage_bench
+// 用法: storage_bench [-l 循环数列表,如1,2,4] [-w 工作线程数] [-c 客户端连接数] [-t 秒数]
+//                     [-n 文件数] [-s 文件大小] [-C 关闭缓存] [-p 端口]
+#include <iostream>
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/stat.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <event2/buffer.h>
+#include <event2/http.h>
+#include <event2/keyvalq_struct.h>
+#include "EventLoopGroup.hpp"
+#include "HotCache.hpp"
+
+struct Options {
+    std::vector<size_t> loops{1};
+    size_t workers = 2;
+    size_t clients = 8;
+    int seconds = 3;
+    size_t files = 100;
+    size_t file_size = 4096;
+    bool cache = true;
+    uint16_t port = 18080;
+    std::string dir = "/tmp/storage_bench";
+};
+
+static std::vector<size_t> ParseList(const char *s) {
+    std::vector<size_t> v;
+    while(*s) {
+        char *end;
+        v.push_back(strtoul(s, &end, 10));
+        s = (*end == ',') ? end + 1 : end;
+        if(end == s && *s) break;
+    }
+    return v;
+}
+
+static void PrepareFiles(const Options &opt) {
+    mkdir(opt.dir.c_str(), 0755);
+    std::string data(opt.file_size, 'x');
+    for(size_t i = 0; i < opt.files; i++) {
+        std::string path = opt.dir + "/f" + std::to_string(i);
+        FILE *fs = fopen(path.c_str(), "wb");
+        if(fs == NULL) {
+            perror(path.c_str());
+            exit(1);
+        }
+        fwrite(data.data(), 1, data.size(), fs);
+        fclose(fs);
+    }
+}
+
+static bool ReadFile(const std::string &path, std::string *out) {
+    int fd = open(path.c_str(), O_RDONLY);
+    if(fd < 0) return false;
+    struct stat st;
+    fstat(fd, &st);
+    out->resize(st.st_size);
+    ssize_t n = st.st_size > 0 ? read(fd, &(*out)[0], st.st_size) : 0;
+    close(fd);
+    return n == st.st_size;
+}
+
+// 与服务端下载接口相同的处理方式：命中缓存直接引用发送；未命中时读文件交给工作线程，回到循环后放入缓存并响应
+static void HandleDownload(storage::EventLoopGroup *group, storage::HotCache *cache,
+                           const Options &opt, evhttp_request *req) {
+    const char *uri = evhttp_request_get_uri(req);
+    const char *prefix = "/download/";
+    if(strncmp(uri, prefix, strlen(prefix)) != 0) {
+        evhttp_send_reply(req, HTTP_NOTFOUND, "Not Found", NULL);
+        return;
+    }
+    std::string key = uri + strlen(prefix);
+    if(cache) {
+        storage::CacheObject::ptr obj = cache->Lookup(key);
+        if(obj) {
+            storage::HotCache::AttachTo(req, obj);
+            evhttp_send_reply(req, HTTP_OK, "OK", NULL);
+            return;
+        }
+    }
+    std::string path = opt.dir + "/" + key;
+    if(cache == nullptr) {
+        // 不使用缓存时在循环线程中直接发送文件
+        int fd = open(path.c_str(), O_RDONLY);
+        struct stat st;
+        if(fd < 0 || fstat(fd, &st) < 0) {
+            if(fd >= 0) close(fd);
+            evhttp_send_reply(req, HTTP_NOTFOUND, "Not Found", NULL);
+            return;
+        }
+        evhttp_add_header(evhttp_request_get_output_headers(req), "Content-Type", "application/octet-stream");
+        evbuffer_add_file(evhttp_request_get_output_buffer(req), fd, 0, st.st_size);
+        evhttp_send_reply(req, HTTP_OK, "OK", NULL);
+        return;
+    }
+    storage::EventLoop::ptr loop = group->LoopOf(req);
+    uint64_t gen = cache->Generation();
+    auto body = std::make_shared<std::string>();
+    auto ok = std::make_shared<bool>(false);
+    group->Offload(loop, [path, body, ok]() {
+        *ok = ReadFile(path, body.get());
+    }, [req, cache, key, gen, body, ok]() {
+        if(!*ok) {
+            evhttp_send_reply(req, HTTP_NOTFOUND, "Not Found", NULL);
+            return;
+        }
+        std::vector<std::pair<std::string, std::string>> headers;
+        headers.emplace_back("Content-Type", "application/octet-stream");
+        evhttp_add_header(evhttp_request_get_output_headers(req), "Content-Type", "application/octet-stream");
+        evbuffer_add(evhttp_request_get_output_buffer(req), body->data(), body->size());
+        cache->Put(key, gen, std::move(*body), std::move(headers));
+        evhttp_send_reply(req, HTTP_OK, "OK", NULL);
+    });
+}
+
+// 长连接客户端：发送请求，按Content-Length读完响应体后发下一个请求
+static void Client(const Options &opt, uint16_t port, size_t id, std::atomic<bool> *stop,
+                   std::atomic<size_t> *done, std::atomic<size_t> *errors) {
+    int fd = socket(AF_INET, SOCK_STREAM, 0);
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    struct sockaddr_in addr;
+    memset(&addr, 0, sizeof(addr));
+    addr.sin_family = AF_INET;
+    addr.sin_port = htons(port);
+    inet_aton("127.0.0.1", &addr.sin_addr);
+    if(connect(fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) < 0) {
+        perror("connect");
+        ++*errors;
+        close(fd);
+        return;
+    }
+    std::string buf;
+    char tmp[65536];
+    size_t n = id;
+    while(!stop->load(std::memory_order_relaxed)) {
+        std::string request = "GET /download/f" + std::to_string(n++ % opt.files) +
+                              " HTTP/1.1\r\nHost: 127.0.0.1\r\n\r\n";
+        if(send(fd, request.data(), request.size(), MSG_NOSIGNAL) != static_cast<ssize_t>(request.size())) {
+            ++*errors;
+            break;
+        }
+        size_t header_end = std::string::npos, need = 0;
+        while(true) {
+            if(header_end == std::string::npos) {
+                header_end = buf.find("\r\n\r\n");
+                if(header_end != std::string::npos) {
+                    size_t cl = buf.find("Content-Length:");
+                    size_t len = (cl != std::string::npos && cl < header_end) ? strtoul(buf.c_str() + cl + 15, NULL, 10) : 0;
+                    if(buf.compare(9, 3, "200") != 0) ++*errors;
+                    need = header_end + 4 + len;
+                }
+            }
+            if(header_end != std::string::npos && buf.size() >= need) break;
+            ssize_t r = recv(fd, tmp, sizeof(tmp), 0);
+            if(r <= 0) {
+                ++*errors;
+                close(fd);
+                return;
+            }
+            buf.append(tmp, r);
+        }
+        buf.erase(0, need);
+        ++*done;
+    }
+    close(fd);
+}
+
+int main(int argc, char *argv[]) {
+    Options opt;
+    int c;
+    while((c = getopt(argc, argv, "l:w:c:t:n:s:Cp:")) != -1) {
+        switch(c) {
+            case 'l': opt.loops = ParseList(optarg); break;
+            case 'w': opt.workers = atoi(optarg); break;
+            case 'c': opt.clients = atoi(optarg); break;
+            case 't': opt.seconds = atoi(optarg); break;
+            case 'n': opt.files = atoi(optarg); break;
+            case 's': opt.file_size = atoi(optarg); break;
+            case 'C': opt.cache = false; break;
+            case 'p': opt.port = atoi(optarg); break;
+            default:
+                std::cerr << "usage: " << argv[0] << " [-l loops,...] [-w workers] [-c clients] [-t seconds]"
+                          << " [-n files] [-s file_size] [-C] [-p port]" << std::endl;
+                return 2;
+        }
+    }
+    if(opt.files == 0) opt.files = 1;
+    PrepareFiles(opt);
+
+    for(size_t i = 0; i < opt.loops.size(); i++) {
+        uint16_t port = opt.port + i; // 每轮换一个端口，避免上一轮的TIME_WAIT影响
+        std::unique_ptr<storage::HotCache> cache;
+        if(opt.cache) cache.reset(new storage::HotCache(64 * 1024 * 1024, 1024 * 1024));
+        storage::EventLoopGroup group(opt.loops[i], opt.workers);
+        if(!group.Listen("127.0.0.1", port)) {
+            std::cerr << "listen on port " << port << " failed" << std::endl;
+            return 1;
+        }
+        storage::EventLoopGroup *g = &group;
+        storage::HotCache *hc = cache.get();
+        group.SetHandler([g, hc, &opt](evhttp_request *req) {
+            HandleDownload(g, hc, opt, req);
+        });
+        group.Start();
+
+        std::atomic<bool> stop(false);
+        std::atomic<size_t> done(0), errors(0);
+        std::vector<std::thread> clients;
+        auto t0 = std::chrono::steady_clock::now();
+        for(size_t k = 0; k < opt.clients; k++) {
+            clients.emplace_back(Client, std::cref(opt), port, k, &stop, &done, &errors);
+        }
+        std::this_thread::sleep_for(std::chrono::seconds(opt.seconds));
+        stop = true;
+        for(auto &t : clients) t.join();
+        double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+        group.Stop();
+
+        printf("loops=%zu cache=%s clients=%zu size=%zu: %.0f req/s, %zu errors",
+               opt.loops[i], opt.cache ? "on" : "off", opt.clients, opt.file_size, done / secs, errors.load());
+        if(cache) {
+            storage::CacheStats st = cache->Stats();
+            printf(", hit ratio %.3f", st.HitRatio());
+        }
+        printf("\n");
+    }
+    return 0;
+}
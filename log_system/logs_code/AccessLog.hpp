@@ -0,0 +1,337 @@
+#pragma once
+// 访问日志：存储服务每个HTTP请求都会产生一条访问日志，走通用的vasprintf + LogMessage::format()代价太高。
+// 这里请求线程只把固定字段打包成二进制记录写入专用的异步缓冲区，格式化成文本或JSON的工作全部交给后台线程
+#include <string>
+#include <vector>
+#include <memory>
+#include <mutex>
+#include <atomic>
+#include <thread>
+#include <condition_variable>
+#include <cstring>
+#include <cstdint>
+#include <ctime>
+#include <algorithm>
+#include <sys/uio.h>
+#include "AsyncWorker.hpp"
+#include "logFlush.hpp"
+
+namespace mylog {
+    enum class AccessMethod : uint8_t { GET, POST, PUT, DELETE, HEAD, OTHER };
+    enum class AccessFormat { TEXT, JSON };
+
+    // 打包写入缓冲区的定长记录头，后面紧跟path_len字节的路径
+    struct AccessRecord {
+        int64_t time_us; // 请求完成时间，微秒
+        uint64_t bytes; // 响应字节数
+        uint32_t latency_us; // 处理耗时，微秒
+        uint16_t status; // HTTP状态码
+        uint8_t method;
+        uint8_t path_len; // 路径长度，超过255字节的路径会被截断
+        char client[24]; // 客户端地址
+    };
+
+    class AccessLogger {
+        public:
+            using ptr = std::shared_ptr<AccessLogger>;
+            static const size_t kMaxPath = 255;
+            // 暂存区中的记录最多滞留50ms，由刷新线程保证；之后异步线程还会再攒批最多flush_interval_ms，
+            // 所以一条记录从写入到交给落地方向最多约kMaxDelayUs + flush_interval_ms
+            static const int64_t kMaxDelayUs = 50000;
+            static const size_t kStagingSize = 64 * 1024; // 每个线程暂存区的大小，必须是2的幂
+
+            AccessLogger(std::vector<LogFlush::ptr> &flushs, AccessFormat format = AccessFormat::TEXT,
+                         AsyncType type = AsyncType::ASYNC_SAFE)
+                : format_(format),
+                  flushs_(flushs.begin(), flushs.end()),
+                  id_(NextId()),
+                  asyncworker(std::make_shared<AsyncWorker>(
+                    std::bind(&AccessLogger::RealFlush, this, std::placeholders::_1),
+                    type)),
+                  flusher_(&AccessLogger::FlusherEntry, this) {}
+
+            ~AccessLogger() {
+                {
+                    std::unique_lock<std::mutex> lock(flusher_mtx_);
+                    stop_ = true;
+                    flusher_cond_.notify_one();
+                }
+                flusher_.join();
+                DrainAll(); // 包括已经退出的线程留下的记录
+                asyncworker->Stop();
+            }
+
+            // 请求线程调用：只做定长字段拷贝，记录先攒在线程私有的环形暂存区里，攒满一批才写入异步缓冲区。
+            // 暂存区是单生产者环：请求线程只写head，刷新线程写出后只推进tail，正常路径不加锁；
+            // 只有暂存区写满时请求线程才加drain_mtx自己写出一批
+            void Log(AccessMethod method, const char *path, size_t path_len, uint16_t status,
+                     uint64_t bytes, uint32_t latency_us, const char *client) {
+                Staging &st = LocalStaging();
+                if(path_len > kMaxPath) path_len = kMaxPath;
+                size_t len = RecordSize(path_len);
+                uint64_t head = st.head.load(std::memory_order_relaxed);
+                if(head + len - st.tail.load(std::memory_order_acquire) > kStagingSize) {
+                    std::unique_lock<std::mutex> lock(st.drain_mtx);
+                    DrainLocked(st);
+                }
+
+                size_t off = head & (kStagingSize - 1);
+                if(off + len <= kStagingSize) {
+                    // 常见情况：记录不跨越环的末尾，直接在暂存区里填写，省去一次拷贝
+                    AccessRecord *r = reinterpret_cast<AccessRecord*>(st.data + off);
+                    FillRecord(r, method, path_len, status, bytes, latency_us, client);
+                    memcpy(r + 1, path, path_len);
+                } else {
+                    AccessRecord r;
+                    FillRecord(&r, method, path_len, status, bytes, latency_us, client);
+                    CopyIn(st, head, reinterpret_cast<const char*>(&r), sizeof(r));
+                    CopyIn(st, head + sizeof(r), path, path_len);
+                }
+                // 与刷新线程清除armed_后读取head构成配对，两边都用seq_cst，保证新记录不会既没被写出也没唤醒刷新线程
+                st.head.store(head + len, std::memory_order_seq_cst);
+                if(!armed_.load(std::memory_order_seq_cst)) Arm();
+            }
+
+            // 把当前线程暂存的记录立即写入异步缓冲区，不必等待刷新线程
+            void FlushThread() {
+                Staging &st = LocalStaging();
+                std::unique_lock<std::mutex> lock(st.drain_mtx);
+                DrainLocked(st);
+            }
+
+            static AccessMethod MethodOf(const char *method) {
+                if(strcmp(method, "GET") == 0) return AccessMethod::GET;
+                if(strcmp(method, "POST") == 0) return AccessMethod::POST;
+                if(strcmp(method, "PUT") == 0) return AccessMethod::PUT;
+                if(strcmp(method, "DELETE") == 0) return AccessMethod::DELETE;
+                if(strcmp(method, "HEAD") == 0) return AccessMethod::HEAD;
+                return AccessMethod::OTHER;
+            }
+
+        private:
+            // 线程私有暂存区，同时登记在日志器中，由刷新线程定期写出；线程退出后仍由日志器持有，剩余记录不会丢失。
+            // head和tail是单调递增的字节位置，在环中的下标为对kStagingSize取模
+            struct Staging {
+                std::atomic<uint64_t> head{0}; // 请求线程写到的位置，只有请求线程修改
+                char pad_[64]; // head和tail不放在同一缓存行
+                std::atomic<uint64_t> tail{0}; // 已经写入异步缓冲区的位置，持有drain_mtx时修改
+                std::mutex drain_mtx; // 写出暂存区的一方(刷新线程或写满时的请求线程)之间互斥
+                alignas(8) char data[kStagingSize]; // 记录长度按8字节对齐，环内的记录头都是对齐的
+            };
+
+            static uint64_t NextId() {
+                static std::atomic<uint64_t> id{0};
+                return ++id;
+            }
+
+            // 当前线程在本日志器中的暂存区，第一次使用时创建并登记。每个线程按日志器编号保存自己的各个暂存区，
+            // 交替写多个日志器时不会反复创建；按编号区分日志器，日志器析构后地址被复用也不会混淆
+            Staging &LocalStaging() {
+                struct Slot {
+                    uint64_t id;
+                    std::shared_ptr<Staging> st;
+                };
+                static thread_local std::vector<Slot> slots;
+                if(!slots.empty() && slots[0].id == id_) return *slots[0].st;
+                size_t i = 0;
+                while(i < slots.size() && slots[i].id != id_) i++;
+                if(i == slots.size()) {
+                    // 日志器析构后只剩本线程引用的暂存区(数据已经在析构时写出)，顺便清理掉
+                    size_t keep = 0;
+                    for(size_t j = 0; j < slots.size(); j++) {
+                        if(slots[j].st.use_count() > 1) slots[keep++] = std::move(slots[j]);
+                    }
+                    slots.resize(keep);
+                    Slot slot{id_, std::make_shared<Staging>()};
+                    {
+                        std::unique_lock<std::mutex> lock(stagings_mtx_);
+                        stagings_.push_back(slot.st);
+                    }
+                    slots.push_back(std::move(slot));
+                    i = slots.size() - 1;
+                }
+                // 最近使用的移到最前面，只写一个日志器时第一次比较就命中
+                std::swap(slots[0], slots[i]);
+                return *slots[0].st;
+            }
+
+            static void FillRecord(AccessRecord *r, AccessMethod method, size_t path_len, uint16_t status,
+                                   uint64_t bytes, uint32_t latency_us, const char *client) {
+                struct timespec ts;
+                clock_gettime(CLOCK_REALTIME_COARSE, &ts); // 粗粒度时钟走vdso，几纳秒即可返回
+                r->time_us = static_cast<int64_t>(ts.tv_sec) * 1000000 + ts.tv_nsec / 1000;
+                r->bytes = bytes;
+                r->latency_us = latency_us;
+                r->status = status;
+                r->method = static_cast<uint8_t>(method);
+                r->path_len = static_cast<uint8_t>(path_len);
+                strncpy(r->client, client ? client : "-", sizeof(r->client) - 1);
+                r->client[sizeof(r->client) - 1] = '\0';
+            }
+
+            static void CopyIn(Staging &st, uint64_t pos, const char *src, size_t n) {
+                size_t off = pos & (kStagingSize - 1);
+                size_t first = std::min(n, kStagingSize - off);
+                memcpy(st.data + off, src, first);
+                memcpy(st.data, src + first, n - first);
+            }
+
+            // 把[tail, head)作为一个整体写入异步缓冲区，跨越环末尾时分两段；调用者持有drain_mtx
+            void DrainLocked(Staging &st) {
+                uint64_t head = st.head.load(std::memory_order_seq_cst);
+                uint64_t tail = st.tail.load(std::memory_order_relaxed);
+                if(head == tail) return;
+                size_t off = tail & (kStagingSize - 1);
+                size_t n = head - tail;
+                size_t first = std::min(n, kStagingSize - off);
+                struct iovec iov[2];
+                iov[0].iov_base = st.data + off;
+                iov[0].iov_len = first;
+                iov[1].iov_base = st.data;
+                iov[1].iov_len = n - first;
+                // 申请不到缓冲区内存时这一批整体丢弃(计入asyncworker->Dropped())，不会留下半条记录
+                asyncworker->Push(iov, n > first ? 2 : 1);
+                st.tail.store(head, std::memory_order_release);
+            }
+
+            // 写出所有暂存区，并去掉线程已经退出的暂存区
+            void DrainAll() {
+                std::unique_lock<std::mutex> lock(stagings_mtx_);
+                size_t keep = 0;
+                for(size_t i = 0; i < stagings_.size(); i++) {
+                    // 先判断再写出：线程已经退出的暂存区不会再有新记录，写出后即可丢弃
+                    bool orphan = stagings_[i].use_count() == 1;
+                    {
+                        std::unique_lock<std::mutex> st_lock(stagings_[i]->drain_mtx);
+                        DrainLocked(*stagings_[i]);
+                    }
+                    if(!orphan) stagings_[keep++] = stagings_[i];
+                }
+                stagings_.resize(keep);
+            }
+
+            // 暂存区由空变为非空时调用，唤醒刷新线程
+            void Arm() {
+                if(armed_.load(std::memory_order_relaxed)) return;
+                std::unique_lock<std::mutex> lock(flusher_mtx_);
+                if(!armed_.exchange(true)) flusher_cond_.notify_one();
+            }
+
+            // 刷新线程：没有暂存数据时挂起；有数据后等待kMaxDelayUs再写出所有暂存区，
+            // 所以任何一条记录最多在暂存区中停留kMaxDelayUs(不含异步线程攒批的flush_interval_ms)
+            void FlusherEntry() {
+                std::unique_lock<std::mutex> lock(flusher_mtx_);
+                while(true) {
+                    flusher_cond_.wait(lock, [this]() { return stop_ || armed_.load(); });
+                    if(stop_) return;
+                    flusher_cond_.wait_for(lock, std::chrono::microseconds(kMaxDelayUs), [this]() { return stop_; });
+                    if(stop_) return;
+                    armed_.store(false, std::memory_order_seq_cst); // 在写出之前清除，之后新写入的记录会重新唤醒
+                    lock.unlock();
+                    DrainAll();
+                    lock.lock();
+                }
+            }
+
+            // 记录按8字节对齐，保证缓冲区中每条记录头都是对齐访问
+            static size_t RecordSize(size_t path_len) {
+                return (sizeof(AccessRecord) + path_len + 7) & ~static_cast<size_t>(7);
+            }
+
+            static const char *ToString(uint8_t method) {
+                switch(static_cast<AccessMethod>(method)) {
+                    case AccessMethod::GET:
+                        return "GET";
+                    case AccessMethod::POST:
+                        return "POST";
+                    case AccessMethod::PUT:
+                        return "PUT";
+                    case AccessMethod::DELETE:
+                        return "DELETE";
+                    case AccessMethod::HEAD:
+                        return "HEAD";
+                    default:
+                        return "OTHER";
+                }
+            }
+
+            // 后台线程：逐条解析打包记录，渲染成文本后交给各个落地方向
+            void RealFlush(Buffer &buffer) {
+                out_.clear();
+                // 记录可能跨越缓冲区的内存段，逐条拷贝到栈上再渲染
+                char record[sizeof(AccessRecord) + kMaxPath + 8];
+                AccessRecord r;
+                while(buffer.Read(reinterpret_cast<char*>(&r), sizeof(AccessRecord))) {
+                    size_t rest = RecordSize(r.path_len) - sizeof(AccessRecord);
+                    if(!buffer.Read(record, rest)) break;
+                    Render(r, record);
+                }
+                if(out_.empty()) return;
+                for(auto &e : flushs_) {
+                    e->Flush(out_.data(), out_.size());
+                }
+            }
+
+            void Render(const AccessRecord &r, const char *path) {
+                // 同一秒内的记录复用上一次格式化好的时间
+                time_t sec = r.time_us / 1000000;
+                if(sec != last_sec_) {
+                    struct tm t;
+                    localtime_r(&sec, &t);
+                    strftime(time_buf_, sizeof(time_buf_), "%Y-%m-%d %H:%M:%S", &t);
+                    last_sec_ = sec;
+                }
+                const char *time_buf = time_buf_;
+                char line[256];
+                if(format_ == AccessFormat::TEXT) {
+                    int n = snprintf(line, sizeof(line), "[%s.%06ld] %s %s ", time_buf,
+                                     static_cast<long>(r.time_us % 1000000), r.client, ToString(r.method));
+                    out_.append(line, n);
+                    out_.append(path, r.path_len);
+                    n = snprintf(line, sizeof(line), " %u %llu %uus\n", r.status,
+                                 static_cast<unsigned long long>(r.bytes), r.latency_us);
+                    out_.append(line, n);
+                } else {
+                    int n = snprintf(line, sizeof(line), "{\"time\":\"%s.%06ld\",\"client\":\"%s\",\"method\":\"%s\",\"path\":\"",
+                                     time_buf, static_cast<long>(r.time_us % 1000000), r.client, ToString(r.method));
+                    out_.append(line, n);
+                    AppendJsonEscaped(path, r.path_len);
+                    n = snprintf(line, sizeof(line), "\",\"status\":%u,\"bytes\":%llu,\"latency_us\":%u}\n", r.status,
+                                 static_cast<unsigned long long>(r.bytes), r.latency_us);
+                    out_.append(line, n);
+                }
+            }
+
+            void AppendJsonEscaped(const char *s, size_t len) {
+                for(size_t i = 0; i < len; i++) {
+                    unsigned char c = s[i];
+                    if(c == '"' || c == '\\') {
+                        out_.push_back('\\');
+                        out_.push_back(c);
+                    } else if(c < 0x20) {
+                        char esc[8];
+                        snprintf(esc, sizeof(esc), "\\u%04x", c);
+                        out_.append(esc);
+                    } else {
+                        out_.push_back(c);
+                    }
+                }
+            }
+
+        private:
+            AccessFormat format_;
+            std::string out_; // 渲染结果，只在后台线程使用，复用内存
+            time_t last_sec_ = 0;
+            char time_buf_[32];
+            std::vector<LogFlush::ptr> flushs_; // 输出到指定方向
+            uint64_t id_; // 日志器编号，用于查找线程私有暂存区
+            std::mutex stagings_mtx_;
+            std::vector<std::shared_ptr<Staging>> stagings_; // 所有线程的暂存区
+            std::mutex flusher_mtx_;
+            std::condition_variable flusher_cond_;
+            std::atomic<bool> armed_{false}; // 有暂存区非空，刷新线程需要计时
+            bool stop_ = false;
+            mylog::AsyncWorker::ptr asyncworker;
+            std::thread flusher_; // 必须最后初始化
+    };
+}
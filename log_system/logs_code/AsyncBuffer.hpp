@@ -1,83 +1,248 @@
 #pragma once
 // 日志缓冲区类设计
+// 缓冲区由固定大小的内存段(Segment)串成链表，扩容只需从内存池取一个新段挂到末尾，已有数据不会被拷贝；
+// 内存段用mmap分配，没有写过的页不会占用物理内存；消费者通过iovec数组以writev的方式一次写出所有段。
+// 每个NUMA节点一个内存池，绑定节点的缓冲区只从本节点的池中取段，回收的段不会跨节点复用
 #include <vector>
 #include <string>
-#include "Util.hpp"
+#include <mutex>
+#include <cstring>
 #include <cassert>
+#include <algorithm>
+#include <sys/uio.h>
+#include <sys/mman.h>
+#include "Util.hpp"
+#include "Topology.hpp"
 
 extern mylog::Util::JsonData* g_conf_data;
 
 namespace mylog{
+    // 内存段池，同一节点的缓冲区共享，空闲段超过上限后直接归还给操作系统
+    class SegmentPool {
+        public:
+            static const size_t kSegmentSize = 64 * 1024; // 单个内存段大小
+            static const size_t kMaxFree = 256; // 池中最多缓存的空闲段数量，即16MB
+
+            // 不绑定节点的缓冲区使用的池
+            static SegmentPool &GetInstance() {
+                static SegmentPool pool(Topology::kAnyNode);
+                return pool;
+            }
+
+            static SegmentPool &ForNode(int node) {
+                static std::vector<SegmentPool*> pools = []() {
+                    std::vector<SegmentPool*> v;
+                    for(int n = 0; n < Topology::GetInstance().NodeCount(); n++) {
+                        v.push_back(new SegmentPool(n)); // 与进程同生命周期
+                    }
+                    return v;
+                }();
+                if(node < 0 || node >= static_cast<int>(pools.size())) return GetInstance();
+                return *pools[node];
+            }
+
+            char *Alloc() {
+                {
+                    std::unique_lock<std::mutex> lock(mtx_);
+                    if(!free_.empty()) {
+                        char *seg = free_.back();
+                        free_.pop_back();
+                        return seg;
+                    }
+                }
+                void *seg = mmap(nullptr, kSegmentSize, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+                if(seg == MAP_FAILED) {
+                    perror("mmap segment failed");
+                    return nullptr;
+                }
+                Topology::GetInstance().BindMemory(seg, kSegmentSize, node_);
+                return static_cast<char*>(seg);
+            }
+
+            void Free(char *seg) {
+                {
+                    std::unique_lock<std::mutex> lock(mtx_);
+                    if(free_.size() < kMaxFree) {
+                        free_.push_back(seg);
+                        return;
+                    }
+                }
+                munmap(seg, kSegmentSize);
+            }
+
+        private:
+            explicit SegmentPool(int node) : node_(node) {}
+            int node_; // 所属节点
+            std::mutex mtx_;
+            std::vector<char*> free_; // 空闲段
+    };
+
     class Buffer{
         public:
-            Buffer() : write_pos_(0), read_pos_(0) {
-                buffer_.resize(g_conf_data->buffer_size);
+            static const size_t kRetainSegments = 4; // Reset后保留的段数，突发流量扩出来的其余段归还内存池
+
+            explicit Buffer(int node = Topology::kAnyNode)
+                : pool_(&SegmentPool::ForNode(node)), read_seg_(0), read_off_(0), write_off_(0), size_(0) {}
+
+            ~Buffer() {
+                for(char *seg : segs_) {
+                    pool_->Free(seg);
+                }
+            }
+
+            Buffer(const Buffer &) = delete;
+            Buffer &operator=(const Buffer &) = delete;
+
+            // 写入一条完整的数据：先确保段足够再拷贝，申请不到内存时什么都不写并返回false，
+            // 不会留下半条记录破坏AccessLogger、LogMerger依赖的记录边界
+            bool Push(const char *data, size_t len) {
+                if(!EnsureWritable(len)) return false;
+                // 逐段写入，当前段写满就移到下一个已经准备好的段，整个过程不会移动已有数据
+                while(len > 0) {
+                    if(segs_.empty() || write_off_ == SegmentPool::kSegmentSize) {
+                        Grow();
+                    }
+                    size_t n = std::min(len, SegmentPool::kSegmentSize - write_off_);
+                    memcpy(segs_[fill_seg_] + write_off_, data, n);
+                    write_off_ += n;
+                    size_ += n;
+                    data += n;
+                    len -= n;
+                }
+                return true;
             }
 
-            void Push(const char *data, size_t len) {
-                ToBeEnough(len); // 确保容量足够，不够则扩容
-                // 开始写入
-                std::copy(data, data + len, &buffer_[write_pos_]);
-                write_pos_ += len;
+            // 保证之后写入len字节不需要再申请内存，由多段组成的一条记录(如记录头加内容)先整体调用一次
+            bool EnsureWritable(size_t len) {
+                size_t avail = 0;
+                if(!segs_.empty()) {
+                    avail = SegmentPool::kSegmentSize - write_off_ +
+                            (segs_.size() - fill_seg_ - 1) * SegmentPool::kSegmentSize;
+                }
+                while(avail < len) {
+                    char *seg = pool_->Alloc();
+                    if(seg == nullptr) return false; // 已经申请到的段留在缓冲区中，之后照常使用
+                    segs_.push_back(seg);
+                    avail += SegmentPool::kSegmentSize;
+                }
+                return true;
             }
 
+            // 以配置中的buffer_size作为缓冲区的名义容量，固定容量(ASYNC_SAFE)模式下生产者据此阻塞等待；
+            // 直接读取配置，buffer_size热加载后立即生效
             size_t WriteableSize()  {
-                return buffer_.size() - write_pos_; // 返回写空间剩余容量
+                size_t capacity = g_conf_data->Current().buffer_size;
+                return capacity > size_ ? capacity - size_ : 0;
             }
 
             size_t ReadableSize(){
-                return write_pos_ - read_pos_;
+                return size_;
             }
 
-            char *ReadBegin(int len) {
-                assert(len <= ReadableSize()); // 检查len是否小于等于可读空间
-                return &buffer_[read_pos_]; // 返回读值指针
-            }
-            
             bool IsEmpty() {
-                return write_pos_ == read_pos_;
+                return size_ == 0;
             }
 
-            void Swap(Buffer &buf) {
-                buffer_.swap(buf.buffer_);
-                std::swap(read_pos_, buf.read_pos_);
-                std::swap(write_pos_, buf.write_pos_);
+            // 把所有可读数据填入iov，供writev一次性写出，不发生拷贝
+            void GetIovec(std::vector<struct iovec> *iov) {
+                iov->clear();
+                if(size_ == 0) return;
+                size_t off = read_off_;
+                for(size_t i = read_seg_; i <= fill_seg_; i++) {
+                    size_t end = (i == fill_seg_) ? write_off_ : SegmentPool::kSegmentSize;
+                    if(end > off) {
+                        struct iovec v;
+                        v.iov_base = segs_[i] + off;
+                        v.iov_len = end - off;
+                        iov->push_back(v);
+                    }
+                    off = 0;
+                }
+            }
+
+            // 拷贝出len字节并移动读位置，用于解析可能跨段的定长记录，可读数据不足时返回false
+            bool Read(char *dst, size_t len) {
+                if(len > size_) return false;
+                while(len > 0) {
+                    size_t end = (read_seg_ == fill_seg_) ? write_off_ : SegmentPool::kSegmentSize;
+                    size_t n = std::min(len, end - read_off_);
+                    memcpy(dst, segs_[read_seg_] + read_off_, n);
+                    dst += n;
+                    len -= n;
+                    MoveReadPos(n);
+                }
+                return true;
+            }
+
+            // 预先申请n个段并逐页写入，由绑核后的线程调用，使物理页在该线程所在节点上分配
+            void Reserve(size_t n) {
+                if(!IsEmpty()) return;
+                while(segs_.size() < n) {
+                    char *seg = pool_->Alloc();
+                    if(seg == nullptr) return;
+                    for(size_t off = 0; off < SegmentPool::kSegmentSize; off += 4096) seg[off] = 0;
+                    segs_.push_back(seg);
+                }
             }
 
-            void MoveWritePos(int len) {
-                assert(len <= WriteableSize());
-                write_pos_ += len;
+            // 两个缓冲区必须属于同一节点，交换后段仍归还给原来的池
+            void Swap(Buffer &buf) {
+                assert(pool_ == buf.pool_);
+                segs_.swap(buf.segs_);
+                std::swap(read_seg_, buf.read_seg_);
+                std::swap(read_off_, buf.read_off_);
+                std::swap(write_off_, buf.write_off_);
+                std::swap(fill_seg_, buf.fill_seg_);
+                std::swap(size_, buf.size_);
             }
 
-            void MoveReadPos(int len) {
+            void MoveReadPos(size_t len) {
                 assert(len <= ReadableSize());
-                read_pos_ += len;
+                size_ -= len;
+                read_off_ += len;
+                // 跳过已经读完的段
+                while(read_off_ >= SegmentPool::kSegmentSize && read_seg_ < fill_seg_) {
+                    read_off_ -= SegmentPool::kSegmentSize;
+                    ++read_seg_;
+                }
             }
 
             void Reset() {
-                // 重置缓冲区
-                write_pos_ = 0;
-                read_pos_ = 0;
+                // 重置缓冲区，只保留前几个段，其余归还内存池
+                while(segs_.size() > kRetainSegments) {
+                    pool_->Free(segs_.back());
+                    segs_.pop_back();
+                }
+                read_seg_ = 0;
+                read_off_ = 0;
+                write_off_ = 0;
+                size_ = 0;
+                fill_seg_ = 0;
             }
 
-
         protected:
-            void ToBeEnough(size_t len) {
-                int buffersize = buffer_.size();
-                if(len >= WriteableSize()) {
-                    if(buffer_.size() < g_conf_data->threshold) {
-                        buffer_.resize(2*buffer_.size() + buffersize); //倍数增长为原始容量的三倍
-                    }
-                    else {
-                        buffer_.resize(g_conf_data->linear_growth + buffersize); //容量线性增长
-                    }
+            // 写位置移到下一个段：Reset后保留下来的段或EnsureWritable准备好的段优先复用，不够再从内存池申请
+            bool Grow() {
+                if(!segs_.empty() && fill_seg_ + 1 < segs_.size()) {
+                    ++fill_seg_;
+                    write_off_ = 0;
+                    return true;
                 }
-            }    
+                char *seg = pool_->Alloc();
+                if(seg == nullptr) return false;
+                segs_.push_back(seg);
+                fill_seg_ = segs_.size() - 1;
+                write_off_ = 0;
+                return true;
+            }
 
         protected:
-            std::vector<char> buffer_; // 缓冲区
-            size_t write_pos_; // 生产者此时的位置
-            size_t read_pos_; // 消费者此时的位置
+            SegmentPool *pool_; // 段的来源
+            std::vector<char*> segs_; // 内存段
+            size_t fill_seg_ = 0; // 生产者正在写的段
+            size_t read_seg_; // 消费者所在的段
+            size_t read_off_; // 消费者在段内的位置
+            size_t write_off_; // 生产者在当前段内的位置
+            size_t size_; // 可读数据总量
     };
 }
-
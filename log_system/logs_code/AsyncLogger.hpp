@@ -6,11 +6,12 @@
 #include <cassert>
 #include <cstdarg>
 #include <memory>
+#include <functional>
 #include <unistd.h>
 #include "Level.hpp"
 #include "AsyncWorker.hpp"
 #include "Message.hpp"
-#include "LogFlush.hpp"
+#include "logFlush.hpp"
 #include "backlog/CliBackupLog.hpp"
 #include "ThreadPoll.hpp"
 
@@ -20,21 +21,61 @@ namespace mylog {
     class AsyncLogger {
     public:
         using ptr = std::shared_ptr<AsyncLogger>;
-        AsyncLogger(const std::string &logger_name, std::vector<LogFlush::ptr> &flushs, AsyncType type)
-                : logger_name_(logger_name), // 初始化日志器名字
-                  flushs_(flushs.begin(), flushs.end()), // 添加实例化方式给日志器，如日志输出到文件还是标准输出，可能有多种
-                  asyncworker(std::make_shared<AsyncWorker>(
-                    std::bind(&AsyncLogger::RealFlush, this, std::placeholders::_1),
-                    type)) {}
-
-        virtual ~AsyncLogger() {};
+        // 为第shard个分片创建它自己的落地方向
+        using ShardFlushMaker = std::function<std::vector<LogFlush::ptr>(int shard)>;
+
+        // node为Topology::kPerNode时每个NUMA节点一个异步线程(分片)，生产者写入所在节点的分片；
+        // 为节点编号时唯一的异步线程绑定到该节点；默认不绑定。
+        // 多个分片时order决定各分片的日志以什么顺序落地，window为BOUNDED模式下允许的最大乱序(一条记录最多落后window个序号)。
+        // 多个分片、UNORDERED且给出shard_flush时每个分片一个输出流，各自加锁写出，互不等待；
+        // 否则所有分片共用flushs，按批次串行写出(有序模式必须经过同一个归并)
+        AsyncLogger(const std::string &logger_name, std::vector<LogFlush::ptr> &flushs, AsyncType type,
+                    int node = Topology::kAnyNode, OrderType order = OrderType::UNORDERED, size_t window = 0,
+                    const ShardFlushMaker &shard_flush = nullptr)
+                : logger_name_(logger_name) { // 初始化日志器名字
+            int shards = (node == Topology::kPerNode) ? Topology::GetInstance().NodeCount() : 1;
+            if(shards > 1 && order != OrderType::UNORDERED) { // 只有一个分片时天然有序
+                merger_.reset(new LogMerger(shards, order, window));
+            }
+            if(shards > 1 && !merger_ && shard_flush) {
+                for(int i = 0; i < shards; i++) {
+                    outputs_.emplace_back(new Output);
+                    outputs_.back()->flushs = shard_flush(i);
+                }
+            } else {
+                // 添加实例化方式给日志器，如日志输出到文件还是标准输出，可能有多种
+                outputs_.emplace_back(new Output);
+                outputs_.back()->flushs.assign(flushs.begin(), flushs.end());
+            }
+            asyncworkers_.reserve(shards);
+            for(int i = 0; i < shards; i++) {
+                asyncworkers_.push_back(std::make_shared<AsyncWorker>(
+                    std::bind(&AsyncLogger::RealFlush, this, std::placeholders::_1, i),
+                    type, node == Topology::kPerNode ? i : node));
+            }
+        }
+
+        virtual ~AsyncLogger() {
+            // 回调会访问本对象的成员，先不限时地等待所有异步线程结束，再输出归并剩余的记录、析构成员。
+            // Stop超时的日志器不能走到这里，由LoggerManager::Shutdown保持其存活
+            for(auto &worker : asyncworkers_) {
+                worker->Stop();
+            }
+            FlushMerged();
+        }
         std::string Name() {
             return logger_name_;
         }
 
+        // 低于配置中log_level的日志直接丢弃，log_level可以热加载
+        bool Enabled(LogLevel::value level) {
+            return static_cast<int>(level) >= g_conf_data->Current().log_level;
+        }
+
         // 该函数是特定日志级别的日志信息的格式化，当外部调用该日志器时，使用debug模式的日志就会进来
         // 在serialize时把日志信息中的日志级别定义为DEBUG
         void Debug(const std::string &file, size_t line, const std::string format, ...) {
+            if(!Enabled(LogLevel::value::DEBUG)) return;
             // 获取可变参数列表中的格式
             va_list va;
             va_start(va, format);
@@ -51,6 +92,7 @@ namespace mylog {
         }
 
         void Info(const std::string &file, size_t line, const std::string format, ...) {
+            if(!Enabled(LogLevel::value::INFO)) return;
             // 获取可变参数列表中的格式
             va_list va;
             va_start(va, format);
@@ -67,6 +109,7 @@ namespace mylog {
         }
 
         void Warn(const std::string &file, size_t line, const std::string format, ...) {
+            if(!Enabled(LogLevel::value::WARN)) return;
             // 获取可变参数列表中的格式
             va_list va;
             va_start(va, format);
@@ -83,6 +126,7 @@ namespace mylog {
         }
 
         void Error(const std::string &file, size_t line, const std::string format, ...) {
+            if(!Enabled(LogLevel::value::ERROR)) return;
             // 获取可变参数列表中的格式
             va_list va;
             va_start(va, format);
@@ -99,6 +143,7 @@ namespace mylog {
         }
 
         void Fatal(const std::string &file, size_t line, const std::string format, ...) {
+            if(!Enabled(LogLevel::value::FATAL)) return;
             // 获取可变参数列表中的格式
             va_list va;
             va_start(va, format);
@@ -116,7 +161,26 @@ namespace mylog {
 
 
 
-        
+        // 等待此前写入的日志全部落地(包括fsync等同步操作)，超过deadline返回false
+        bool Drain(AsyncWorker::Clock::time_point deadline) {
+            bool ok = true;
+            for(auto &worker : asyncworkers_) {
+                ok = worker->Drain(deadline) && ok;
+            }
+            return ok;
+        }
+
+        // 落地剩余日志后停止异步线程，之后写入的日志被丢弃，超过deadline返回false；
+        // 返回false时仍有异步线程在运行，调用者不能释放本日志器
+        bool Stop(AsyncWorker::Clock::time_point deadline) {
+            bool ok = true;
+            for(auto &worker : asyncworkers_) {
+                ok = worker->Stop(deadline) && ok;
+            }
+            if(ok) FlushMerged();
+            return ok;
+        }
+
     protected:
         // 在这里将日志消息组织起来，并写入文件
         void serialize(LogLevel::value level, const std::string &file, size_t line, char* ret) {
@@ -137,27 +201,72 @@ namespace mylog {
         }
 
         void Flush(const char* data, size_t len) {
-            asyncworker->Push(data, len); // Push函数本身是线程安全的，这里不加锁
+            // Push函数本身是线程安全的，这里不加锁；分片时写入本节点的分片，避免跨节点访问缓冲区
+            if(asyncworkers_.size() == 1) {
+                asyncworkers_[0]->Push(data, len);
+            } else {
+                asyncworkers_[Topology::GetInstance().CurrentNode() % asyncworkers_.size()]->Push(
+                    data, len, merger_ ? &seq_ : nullptr);
+            }
+        }
+
+        // 所有分片停止后输出归并阶段剩余的记录，此时不再等待缺失的序号
+        void FlushMerged() {
+            Output &out = *outputs_[0]; // 有归并时只有一个输出流
+            if(!merger_ || out.flushs.empty()) return;
+            std::unique_lock<std::mutex> lock(out.mtx);
+            merger_->Collect(&out.iov, true);
+            if(out.iov.empty()) return;
+            for(auto &e : out.flushs) {
+                e->Flush(out.iov.data(), static_cast<int>(out.iov.size()));
+                e->Sync();
+            }
+            merger_->Release();
         }
 
-        void RealFlush(Buffer& buffer) {
+        void RealFlush(Buffer& buffer, size_t shard) {
             // 由异步线程进行实际写文件
-            if(flushs_.empty()) {
+            Output &out = *outputs_[shard % outputs_.size()];
+            if(out.flushs.empty()) {
                 return;
             }
-            for(auto &e : flushs_) {
-                // e是Flush这个类，即控制把日志输出到那个类
-                e->Flush(buffer.Begin(), buffer.ReadableSize());
+            // 共用输出流时各分片的异步线程按批次串行写出；每个分片一个输出流时这把锁不会有竞争
+            std::unique_lock<std::mutex> lock(out.mtx);
+            if(merger_) {
+                // 先归并各分片已到达的记录，按序号输出
+                merger_->Add(shard, buffer);
+                merger_->Collect(&out.iov, false);
+            } else {
+                buffer.GetIovec(&out.iov); // 缓冲区由多个内存段组成，以writev的方式一次写出
+            }
+            if(!out.iov.empty()) {
+                for(auto &e : out.flushs) {
+                    // e是Flush这个类，即控制把日志输出到那个类
+                    e->Flush(out.iov.data(), static_cast<int>(out.iov.size()));
+                }
+            }
+            if(merger_) merger_->Release();
+            if(asyncworkers_[shard]->SyncRequested()) {
+                for(auto &e : out.flushs) {
+                    e->Sync();
+                }
             }
         }
 
 
     protected:
-        std::mutex mtx_;
+        // 一个输出流：落地方向和保护它们的锁
+        struct Output {
+            std::mutex mtx; // 有归并时同时保护merger_
+            std::vector<LogFlush::ptr> flushs; // 输出到指定方向
+            std::vector<struct iovec> iov; // 只在异步线程中使用，由mtx保护
+        };
         std::string logger_name_;
-        std::vector<LogFlush::ptr> flushs_; // 输出到指定方向
+        std::vector<std::unique_ptr<Output>> outputs_; // 共用时只有一个，否则下标即分片编号
         // std::vector<LogFlush> flush_;不能使用logflush作为元素类型，logflush是纯虚羸，不能实例化
-        mylog::AsyncWorker::ptr asyncworker; 
+        std::atomic<uint64_t> seq_{0}; // 需要归并时每条日志的序号
+        std::unique_ptr<LogMerger> merger_; // 多分片且要求有序时才有
+        std::vector<mylog::AsyncWorker::ptr> asyncworkers_; // 每个分片一个异步工作器
     };
 
     // 日治器建造
@@ -170,6 +279,20 @@ namespace mylog {
             void BuildLoggerType(AsyncType type) {
                 async_type_ = type;
             }
+            // 异步线程的放置方式：节点编号、Topology::kPerNode或者Topology::kAnyNode
+            void BuildLoggerNode(int node) {
+                node_ = node;
+            }
+            // 多分片时的输出顺序，window为BOUNDED模式下允许的最大乱序
+            void BuildLoggerOrder(OrderType order, size_t window = 4096) {
+                order_ = order;
+                window_ = window;
+            }
+            // 每个分片单独的输出流，只在kPerNode且UNORDERED时生效，此时代替BuildLoggerFlush的落地方向；
+            // 例如按分片编号生成不同的文件名
+            void BuildLoggerShardFlush(const AsyncLogger::ShardFlushMaker &make) {
+                shard_flush_ = make;
+            }
             template <typename FlushType, typename... Args>
             void BuildLoggerFlush(Args &&...args) {
                 flushs_.emplace_back(
@@ -184,12 +307,16 @@ namespace mylog {
                     flushs_.emplace_back(std::make_shared<StdoutFlush>());
                 }
                 return std::make_shared<AsyncLogger>(
-                    logger_name_, flushs_, async_type_);
+                    logger_name_, flushs_, async_type_, node_, order_, window_, shard_flush_);
             }
 
         protected:
             std::string logger_name_ = "async_logger"; // 日治器名称
             std::vector<mylog::LogFlush::ptr> flushs_; // 写日志方式
             AsyncType async_type_ = AsyncType::ASYNC_SAFE; // 用于控制缓冲区是否增长
+            int node_ = Topology::kAnyNode; // 异步线程和缓冲区所在的节点
+            OrderType order_ = OrderType::UNORDERED; // 多分片时的输出顺序
+            size_t window_ = 4096;
+            AsyncLogger::ShardFlushMaker shard_flush_; // 为空时各分片共用flushs_
     };
 }
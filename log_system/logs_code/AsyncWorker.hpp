@@ -1,81 +1,206 @@
 #pragma once
 #include "AsyncBuffer.hpp"
+#include "LogMerge.hpp"
 #include <functional>
 #include <atomic>
 #include <mutex>
+#include <chrono>
 #include <condition_variable>
 #include <thread>
 
 // 主线程负责往生产者缓冲区写入日志，子线程负责处理消费者缓冲区中的日志
+// 子线程空闲时挂起在条件变量上，不占用CPU；有数据后最多再等待flush_interval_ms攒一批再处理，
+// 生产者只在缓冲区由空变为非空、或者数据量超过一半容量时才唤醒子线程。
+// 指定节点时子线程绑定到该节点的CPU上，缓冲区从该节点的内存池取段，并由子线程预先写入保证物理页在本节点
 namespace mylog {
     enum class AsyncType { ASYNC_SAFE, ASYNC_UNSAFE}; // 异步类型
     using functor = std::function<void(Buffer&)>;
     class AsyncWorker {
         public:
             using ptr = std::shared_ptr<AsyncWorker>;
-            AsyncWorker(const functor& cb, AsyncType asynctype = AsyncType::ASYNC_SAFE) 
-                : async_type_(asynctype), 
-                  callback_(cb),
+            using Clock = std::chrono::steady_clock;
+            AsyncWorker(const functor& cb, AsyncType asynctype = AsyncType::ASYNC_SAFE,
+                        int node = Topology::kAnyNode)
+                : async_type_(asynctype),
+                  node_(node),
                   stop_(false),
+                  buffer_productor_(node),
+                  buffer_consumer_(node),
+                  callback_(cb),
                   thread_(std::thread(&AsyncWorker::ThreadEntry, this)) {}
 
             ~AsyncWorker() {
                 Stop();
             }
 
-            void Push(const char* data, size_t len) {
+            // seq不为空时在日志前写入RecordHeader，序号在锁内分配，保证缓冲区内的记录按序号有序。
+            // 已经停止或者申请不到缓冲区内存时整条丢弃并返回false，不会写入半条记录，也不会占用序号
+            bool Push(const char* data, size_t len, std::atomic<uint64_t> *seq = nullptr) {
+                size_t total = seq ? len + sizeof(RecordHeader) : len;
                 // 如果生产者队列不足以写下len长度数据，并且缓冲区是固定大小，那么阻塞
                 std::unique_lock<std::mutex> lock(mtx_);
+                if(stop_) return false; // 已经停止的工作器不再接收日志，避免固定容量时永久阻塞
                 if(AsyncType::ASYNC_SAFE == async_type_){
                     cond_productor_.wait(lock, [&]() {
-                      return len <= buffer_productor_.WriteableSize();
+                      return stop_ || total <= buffer_productor_.WriteableSize();
                     });
+                    if(stop_) return false;
+                }
+                if(!buffer_productor_.EnsureWritable(total)) {
+                    dropped_.fetch_add(1, std::memory_order_relaxed);
+                    return false;
+                }
+                bool was_empty = buffer_productor_.IsEmpty();
+                if(seq) {
+                    RecordHeader h;
+                    h.seq = seq->fetch_add(1, std::memory_order_relaxed);
+                    h.len = len;
+                    buffer_productor_.Push(reinterpret_cast<const char*>(&h), sizeof(h));
                 }
                 buffer_productor_.Push(data, len);
+                if(was_empty || buffer_productor_.ReadableSize() >= WakeBytes()) {
+                    cond_consumer_.notify_one();
+                }
+                return true;
+            }
+
+            // 把iovcnt段数据作为一个整体写入，中间不会插入其他线程的数据，用于写入跨越环形暂存区末尾的一批记录
+            bool Push(const struct iovec *iov, int iovcnt) {
+                size_t total = 0;
+                for(int i = 0; i < iovcnt; i++) total += iov[i].iov_len;
+                std::unique_lock<std::mutex> lock(mtx_);
+                if(stop_) return false;
+                if(AsyncType::ASYNC_SAFE == async_type_){
+                    cond_productor_.wait(lock, [&]() {
+                      return stop_ || total <= buffer_productor_.WriteableSize();
+                    });
+                    if(stop_) return false;
+                }
+                if(!buffer_productor_.EnsureWritable(total)) {
+                    dropped_.fetch_add(1, std::memory_order_relaxed);
+                    return false;
+                }
+                bool was_empty = buffer_productor_.IsEmpty();
+                for(int i = 0; i < iovcnt; i++) {
+                    buffer_productor_.Push(static_cast<const char*>(iov[i].iov_base), iov[i].iov_len);
+                }
+                if(was_empty || buffer_productor_.ReadableSize() >= WakeBytes()) {
+                    cond_consumer_.notify_one();
+                }
+                return true;
+            }
+
+            // 因为申请不到缓冲区内存而整体丢弃的写入次数
+            uint64_t Dropped() const {
+                return dropped_.load(std::memory_order_relaxed);
+            }
+
+            // 等待调用前写入的所有日志都交给回调处理完毕，超过deadline返回false
+            bool Drain(Clock::time_point deadline) {
+                std::unique_lock<std::mutex> lock(mtx_);
+                if(finished_) return true;
+                uint64_t target = ++drain_requested_;
                 cond_consumer_.notify_one();
+                return cond_drained_.wait_until(lock, deadline, [&]() {
+                    return drained_ >= target || finished_;
+                });
             }
-            
-            void Stop() {
-                stop_ = true;
-                cond_consumer_.notify_all(); // 所有线程把缓冲区内数据处理完就结束了
+
+            // 处理完剩余日志后停止子线程，超过deadline仍未结束返回false，子线程继续运行、不会被detach；
+            // 之后可以再次调用Stop等待。析构时不限时等待子线程结束，所以超时的工作器(以及回调引用的对象)
+            // 不能被释放，进程退出时由调用者保持其存活(见LoggerManager::Shutdown)
+            bool Stop(Clock::time_point deadline = Clock::time_point::max()) {
+                std::unique_lock<std::mutex> join_lock(join_mtx_); // 串行化并发的Stop，只有一个线程join
+                if(!thread_.joinable()) return true; // 已经join过
+                {
+                    std::unique_lock<std::mutex> lock(mtx_);
+                    stop_ = true;
+                    cond_consumer_.notify_all(); // 所有线程把缓冲区内数据处理完就结束了
+                    cond_productor_.notify_all();
+                    if(!cond_drained_.wait_until(lock, deadline, [&]() { return finished_; })) {
+                        return false;
+                    }
+                }
                 thread_.join();
+                return true;
+            }
+
+            // 本轮处理是否需要把落地方向同步到底(有等待中的Drain请求或者正在停止)，只在回调中调用
+            bool SyncRequested() {
+                return drain_pending_ || stop_;
             }
 
         private:
+            static size_t WakeBytes() {
+                return g_conf_data->Current().buffer_size / 2;
+            }
+
             void ThreadEntry() {
+                if(node_ >= 0 && Topology::GetInstance().BindThread(node_)) {
+                    std::unique_lock<std::mutex> lock(mtx_);
+                    buffer_productor_.Reserve(Buffer::kRetainSegments);
+                    buffer_consumer_.Reserve(Buffer::kRetainSegments);
+                }
                 while(1) {
+                    uint64_t drain_target;
                     // 缓冲区交换完就解锁，让productor继续写入书
                     {
                         std::unique_lock<std::mutex> lock(mtx_);
-                        if(buffer_productor_.IsEmpty() && stop_) {
-                            cond_consumer_.wait(lock, [&](){
-                                return stop_ || !buffer_productor_.IsEmpty();
+                        // 没有数据时挂起，直到有数据、停止或者有Drain请求
+                        cond_consumer_.wait(lock, [&](){
+                            return stop_ || drain_requested_ > drained_ || !buffer_productor_.IsEmpty();
+                        });
+                        // 有数据后最多再等待flush_interval_ms，把零散的日志攒成一批写出
+                        auto interval = std::chrono::milliseconds(g_conf_data->Current().flush_interval_ms);
+                        if(interval.count() > 0) {
+                            cond_consumer_.wait_for(lock, interval, [&](){
+                                return stop_ || drain_requested_ > drained_ ||
+                                       buffer_productor_.ReadableSize() >= WakeBytes();
                             });
                         }
+                        drain_target = drain_requested_;
+                        drain_pending_ = drain_target > drained_;
                         buffer_productor_.Swap(buffer_consumer_);
                         // 固定容量的缓冲区才需要唤醒
                         if(async_type_ == AsyncType::ASYNC_SAFE) {
-                            cond_productor_.notify_one();
+                            cond_productor_.notify_all();
                         }
                     }
                     callback_(buffer_consumer_); // 调用回调函数对缓冲区中的数据进行处理
                     buffer_consumer_.Reset();
-                    if(stop_ && buffer_productor_.IsEmpty()) return;
+
+                    std::unique_lock<std::mutex> lock(mtx_);
+                    drain_pending_ = false;
+                    drained_ = drain_target;
+                    if(stop_ && buffer_productor_.IsEmpty()) {
+                        finished_ = true;
+                        cond_drained_.notify_all();
+                        return;
+                    }
+                    cond_drained_.notify_all();
                 }
             }
-        
+
         private:
             AsyncType async_type_;
+            int node_; // 绑定的节点，Topology::kAnyNode表示不绑定
             std::atomic<bool> stop_; // 用于控制异步工作器的启动
+            std::atomic<bool> drain_pending_{false}; // 本轮回调需要同步落地方向
+            std::atomic<uint64_t> dropped_{0}; // 申请不到内存而丢弃的写入次数
+            bool finished_ = false; // 子线程已经退出循环
+            uint64_t drain_requested_ = 0; // Drain请求的序号
+            uint64_t drained_ = 0; // 已完成的Drain序号
             std::mutex mtx_;
+            std::mutex join_mtx_; // 保护thread_的join
             mylog::Buffer buffer_productor_;
             mylog::Buffer buffer_consumer_;
             std::condition_variable cond_productor_;
             std::condition_variable cond_consumer_;
+            std::condition_variable cond_drained_; // 一轮处理完成，唤醒Drain和Stop
+            functor callback_; // 回调函数，用于告知工作器如何落地，必须先于thread_初始化
             std::thread thread_;
-            functor callback_; // 回调函数，用于告知工作器如何落地
 
     };
 
 
-}
\ No newline at end of file
+}
@@ -0,0 +1,113 @@
+#pragma once
+// 配置文件监视器：用inotify监视配置文件所在目录，文件被修改或被替换(编辑器常用先写临时文件再rename的方式)后
+// 调用JsonData::Reload()，新的配置作为一份完整的快照发布给正在运行的日志器，无需重启进程
+#include <string>
+#include <thread>
+#include <atomic>
+#include <cstring>
+#include <unistd.h>
+#include <poll.h>
+#include <sys/inotify.h>
+#include "Util.hpp"
+
+extern mylog::Util::JsonData* g_conf_data;
+
+namespace mylog {
+    class ConfigWatcher {
+        public:
+            // path为空时跟随JsonData::ConfigPath()，之后SetConfigPath()改了路径也会转而监视新的文件
+            explicit ConfigWatcher(const std::string &path = "")
+                : fixed_path_(path) {}
+
+            ~ConfigWatcher() {
+                Stop();
+            }
+
+            bool Start() {
+                inotify_fd_ = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+                if(inotify_fd_ < 0) {
+                    std::cout << __FILE__ << __LINE__ << "inotify_init failed" << std::endl;
+                    perror(NULL);
+                    return false;
+                }
+                if(!Watch(CurrentPath())) {
+                    close(inotify_fd_);
+                    inotify_fd_ = -1;
+                    return false;
+                }
+                stop_ = false;
+                thread_ = std::thread(&ConfigWatcher::ThreadEntry, this);
+                return true;
+            }
+
+            void Stop() {
+                stop_ = true;
+                if(thread_.joinable()) thread_.join();
+                if(inotify_fd_ >= 0) {
+                    close(inotify_fd_);
+                    inotify_fd_ = -1;
+                    wd_ = -1;
+                }
+            }
+
+        private:
+            std::string CurrentPath() {
+                return fixed_path_.empty() ? Util::JsonData::ConfigPath() : fixed_path_;
+            }
+
+            // 监视path所在的目录，替换掉之前的监视
+            bool Watch(const std::string &path) {
+                std::string dir = Util::File::Path(path);
+                if(dir.empty()) dir = "./";
+                int wd = inotify_add_watch(inotify_fd_, dir.c_str(), IN_CLOSE_WRITE | IN_MOVED_TO | IN_CREATE);
+                if(wd < 0) {
+                    std::cout << __FILE__ << __LINE__ << "watch " << dir << " failed" << std::endl;
+                    perror(NULL);
+                    return false;
+                }
+                // 新旧文件在同一个目录时inotify返回同一个wd，不能删掉
+                if(wd_ >= 0 && wd_ != wd) inotify_rm_watch(inotify_fd_, wd_);
+                wd_ = wd;
+                path_ = path;
+                size_t pos = path.find_last_of("/\\");
+                filename_ = (pos == std::string::npos) ? path : path.substr(pos + 1);
+                return true;
+            }
+
+            void ThreadEntry() {
+                // 对齐到inotify_event，一次read可以取出多个事件
+                alignas(struct inotify_event) char buf[4096];
+                while(!stop_) {
+                    // 配置路径被SetConfigPath()修改时转而监视新文件；SetConfigPath()自己已经按新路径加载过
+                    std::string path = CurrentPath();
+                    if(path != path_ && !Watch(path)) {
+                        std::cout << __FILE__ << __LINE__ << "keep watching " << path_ << std::endl;
+                    }
+                    struct pollfd pfd = { inotify_fd_, POLLIN, 0 };
+                    if(poll(&pfd, 1, 500) <= 0) continue; // 超时用于检查stop_和配置路径
+                    bool changed = false;
+                    ssize_t n;
+                    while((n = read(inotify_fd_, buf, sizeof(buf))) > 0) {
+                        for(char *p = buf; p < buf + n;) {
+                            auto *ev = reinterpret_cast<struct inotify_event*>(p);
+                            if(ev->wd == wd_ && ev->len > 0 && filename_ == ev->name) changed = true;
+                            p += sizeof(struct inotify_event) + ev->len;
+                        }
+                    }
+                    if(changed && g_conf_data->Reload(path_)) {
+                        std::cout << "config reloaded from " << path_ << ", version "
+                                  << g_conf_data->Current().version << std::endl;
+                    }
+                }
+            }
+
+        private:
+            std::string fixed_path_; // 构造时指定的路径，为空表示跟随JsonData::ConfigPath()
+            std::string path_; // 正在监视的配置文件
+            std::string filename_;
+            int inotify_fd_ = -1;
+            int wd_ = -1;
+            std::atomic<bool> stop_{true};
+            std::thread thread_;
+    };
+}
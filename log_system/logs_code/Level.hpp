@@ -5,6 +5,12 @@ namespace mylog {
     class LogLevel {
         public:
             enum class value { DEBUG, INFO, WARN, ERROR, FATAL};
+            // 与AsyncLogger的Debug/Info等接口同名的级别常量，供以接口名传入级别的宏(如LOG_DEDUP)使用
+            static const value Debug = value::DEBUG;
+            static const value Info = value::INFO;
+            static const value Warn = value::WARN;
+            static const value Error = value::ERROR;
+            static const value Fatal = value::FATAL;
 
             //提供日志等级的字符串转换接口
             static const char* ToString(value level) {
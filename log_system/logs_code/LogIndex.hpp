@@ -0,0 +1,239 @@
+#pragma once
+// 日志索引：滚动日志的每个文件旁边写一个同名的.idx文件，日志按块(约32KB，按行切分)建立稀疏索引，
+// 每块记录文件偏移、时间范围、出现过的日志等级位图，以及整行(时间、线程id、等级、日志器名、文件名和消息)
+// 所有单词的布隆过滤器。检索工具(tools/log_search.cpp)先读索引跳过不可能命中的块，再对剩下的块做子串匹配；
+// 模式串中的完整单词一定也是命中行中的完整单词，所以跳过的块里一定没有命中行。
+// 本文件不依赖jsoncpp等第三方库，检索工具可以单独编译
+#include <string>
+#include <vector>
+#include <cstdio>
+#include <cstring>
+#include <cstdint>
+#include <ctime>
+#ifdef __SSE2__
+#include <emmintrin.h>
+#endif
+
+namespace mylog {
+    namespace index {
+        // 版本2起布隆过滤器覆盖整行；版本1的索引只有日志器名和消息单词，检索工具不再使用，按无索引整体扫描
+        static const char kMagic[8] = {'M', 'L', 'I', 'D', 'X', '2', '\0', '\0'};
+        static const size_t kBlockSize = 32 * 1024; // 索引块大小
+        static const size_t kBloomBytes = 2048; // 每块布隆过滤器16384位，32KB的块整行约有一千多个不同单词，误判率约1%
+        static const size_t kMinToken = 3; // 长度小于3的单词不进入布隆过滤器
+
+        // 索引文件中的一项，对应日志文件中的一块
+        struct BlockEntry {
+            uint64_t offset; // 块在日志文件中的偏移
+            uint64_t length; // 块长度
+            int64_t min_time; // 块内日志写入磁盘的最早时间(秒)
+            int64_t max_time; // 最晚时间
+            uint32_t level_bits; // 第i位表示块内出现过等级i(LogLevel::value)的日志，有无法解析的行时全部置位
+            uint32_t reserved;
+            uint8_t bloom[kBloomBytes];
+        };
+
+        inline uint64_t Hash(const char *s, size_t len) {
+            uint64_t hash = 1469598103934665603ULL;
+            for(size_t i = 0; i < len; i++) {
+                hash ^= static_cast<unsigned char>(s[i]);
+                hash *= 1099511628211ULL;
+            }
+            return hash;
+        }
+
+        // 双重哈希得到4个位置
+        inline void BloomAdd(uint8_t *bloom, const char *s, size_t len) {
+            uint64_t h = Hash(s, len);
+            uint32_t h1 = static_cast<uint32_t>(h), h2 = static_cast<uint32_t>(h >> 32);
+            for(uint32_t i = 0; i < 4; i++) {
+                uint32_t bit = (h1 + i * h2) % (kBloomBytes * 8);
+                bloom[bit >> 3] |= static_cast<uint8_t>(1u << (bit & 7));
+            }
+        }
+
+        inline bool BloomMayContain(const uint8_t *bloom, const char *s, size_t len) {
+            uint64_t h = Hash(s, len);
+            uint32_t h1 = static_cast<uint32_t>(h), h2 = static_cast<uint32_t>(h >> 32);
+            for(uint32_t i = 0; i < 4; i++) {
+                uint32_t bit = (h1 + i * h2) % (kBloomBytes * 8);
+                if((bloom[bit >> 3] & (1u << (bit & 7))) == 0) return false;
+            }
+            return true;
+        }
+
+        inline bool IsTokenChar(char c) {
+            return (c >= 'a' && c <= 'z') || (c >= 'A' && c <= 'Z') || (c >= '0' && c <= '9') ||
+                   c == '_' || (static_cast<unsigned char>(c) & 0x80);
+        }
+
+        // 把s中的单词依次交给cb，interior_only为true时跳过首尾可能被截断的单词(用于检索串)
+        template <typename Callback>
+        void ForEachToken(const char *s, size_t len, bool interior_only, Callback cb) {
+            size_t i = 0;
+            while(i < len) {
+                while(i < len && !IsTokenChar(s[i])) i++;
+                size_t start = i;
+                while(i < len && IsTokenChar(s[i])) i++;
+                if(i - start < kMinToken) continue;
+                if(interior_only && (start == 0 || i == len)) continue;
+                cb(s + start, i - start);
+            }
+        }
+
+        static const char *const kLevelNames[] = {"DEBUG", "INFO", "WARM", "ERROR", "FATAL"};
+        static const uint32_t kAllLevels = (1u << 5) - 1;
+
+        // 解析一行日志: [时:分:秒.微秒][线程id[等级][日志器名][文件:行号]\t消息
+        // 等级只在线程id之后的固定位置识别，消息里出现的"[DEBUG]["之类的文字不会被误认。
+        // 返回等级下标，不是日志头的行(如多行消息的后续行)返回-1；name/payload指向行内对应的位置
+        inline int ParseLine(const char *line, size_t len, const char **name, size_t *name_len,
+                             const char **payload, size_t *payload_len) {
+            const char *end = line + len;
+            if(len == 0 || line[0] != '[') return -1;
+            const char *p = static_cast<const char*>(memchr(line, ']', len));
+            if(p == nullptr || end - p < 2 || p[1] != '[') return -1;
+            p += 2;
+            const char *tid = p;
+            while(p < end && *p >= '0' && *p <= '9') p++;
+            if(p == tid || p == end || *p != '[') return -1;
+            p++;
+            for(int lv = 0; lv < 5; lv++) {
+                size_t n = strlen(kLevelNames[lv]);
+                if(static_cast<size_t>(end - p) < n + 2 || memcmp(p, kLevelNames[lv], n) != 0 ||
+                   p[n] != ']' || p[n + 1] != '[') continue;
+                const char *nm = p + n + 2;
+                const char *close = static_cast<const char*>(memchr(nm, ']', end - nm));
+                if(close == nullptr) return lv;
+                *name = nm;
+                *name_len = close - nm;
+                const char *tab = static_cast<const char*>(memchr(close, '\t', end - close));
+                *payload = tab ? tab + 1 : end;
+                *payload_len = end - *payload;
+                return lv;
+            }
+            return -1;
+        }
+
+        // 子串查找：SSE2下同时比较首字符和尾字符，两者都命中的位置才做memcmp，其余情况退化为memmem
+        inline const char *FindSubstr(const char *hay, size_t n, const char *needle, size_t m) {
+            if(m == 0) return hay;
+            if(m > n) return nullptr;
+            if(m == 1) return static_cast<const char*>(memchr(hay, needle[0], n));
+#ifdef __SSE2__
+            const __m128i first = _mm_set1_epi8(needle[0]);
+            const __m128i last = _mm_set1_epi8(needle[m - 1]);
+            size_t i = 0;
+            for(; i + m - 1 + 16 <= n; i += 16) {
+                __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(hay + i));
+                __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(hay + i + m - 1));
+                unsigned mask = _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(a, first), _mm_cmpeq_epi8(b, last)));
+                while(mask) {
+                    unsigned bit = __builtin_ctz(mask);
+                    if(memcmp(hay + i + bit + 1, needle + 1, m - 2) == 0) return hay + i + bit;
+                    mask &= mask - 1;
+                }
+            }
+            return static_cast<const char*>(memmem(hay + i, n - i, needle, m));
+#else
+            return static_cast<const char*>(memmem(hay, n, needle, m));
+#endif
+        }
+
+        // 由日志落地方向在写入文件的同时调用，按块生成索引
+        class IndexWriter {
+            public:
+                ~IndexWriter() {
+                    Close();
+                }
+
+                // start_offset为日志文件打开时已有的长度，以追加方式打开已存在的文件时偏移从这里开始
+                bool Open(const std::string &path, uint64_t start_offset = 0) {
+                    Close();
+                    fs_ = fopen(path.c_str(), "wb");
+                    if(fs_ == NULL) {
+                        std::perror("open index file failed");
+                        return false;
+                    }
+                    fwrite(kMagic, 1, sizeof(kMagic), fs_);
+                    if(start_offset > 0) {
+                        // 已有的内容没有逐行索引，写一个覆盖[0, start_offset)、任何条件都可能命中的块，检索时总会扫描
+                        memset(&block_, 0xff, sizeof(block_));
+                        block_.offset = 0;
+                        block_.length = start_offset;
+                        block_.min_time = 0;
+                        block_.max_time = INT64_MAX;
+                        block_.reserved = 0;
+                        fwrite(&block_, 1, sizeof(block_), fs_);
+                        fflush(fs_);
+                    }
+                    offset_ = start_offset;
+                    line_.clear();
+                    StartBlock();
+                    return true;
+                }
+
+                // 写完一块数据后调用，data必须与日志文件中的字节完全一致
+                void Append(const char *data, size_t len) {
+                    if(fs_ == NULL) return;
+                    block_.max_time = time(nullptr);
+                    while(len > 0) {
+                        const char *nl = static_cast<const char*>(memchr(data, '\n', len));
+                        size_t n = nl ? nl - data + 1 : len;
+                        line_.append(data, n);
+                        data += n;
+                        len -= n;
+                        if(nl) {
+                            AddLine();
+                            if(block_.length >= kBlockSize) FinishBlock();
+                        }
+                    }
+                }
+
+                void Close() {
+                    if(fs_ == NULL) return;
+                    if(!line_.empty()) AddLine();
+                    FinishBlock();
+                    fclose(fs_);
+                    fs_ = NULL;
+                }
+
+            private:
+                void StartBlock() {
+                    memset(&block_, 0, sizeof(block_));
+                    block_.offset = offset_;
+                    block_.min_time = block_.max_time = time(nullptr);
+                }
+
+                void AddLine() {
+                    const char *name = nullptr, *payload = nullptr;
+                    size_t name_len = 0, payload_len = 0;
+                    int lv = ParseLine(line_.data(), line_.size(), &name, &name_len, &payload, &payload_len);
+                    // 无法解析的行不知道等级，按任何等级都可能出现处理
+                    block_.level_bits |= lv >= 0 ? 1u << lv : kAllLevels;
+                    // 日志器名整体也加入，检索工具按-n的完整名字判断(名字里可能有'-'、'.'等非单词字符)
+                    if(lv >= 0 && name) BloomAdd(block_.bloom, name, name_len);
+                    ForEachToken(line_.data(), line_.size(), false, [this](const char *t, size_t n) {
+                        BloomAdd(block_.bloom, t, n);
+                    });
+                    block_.length += line_.size();
+                    offset_ += line_.size();
+                    line_.clear();
+                }
+
+                void FinishBlock() {
+                    if(block_.length > 0) {
+                        fwrite(&block_, 1, sizeof(block_), fs_);
+                        fflush(fs_); // 索引项写满一块就落盘，检索工具可以读取正在写的文件
+                    }
+                    StartBlock();
+                }
+
+            private:
+                FILE *fs_ = NULL;
+                uint64_t offset_ = 0; // 已经建立索引的字节数，即下一块的起始偏移
+                std::string line_; // 跨越多次Append的不完整行
+                BlockEntry block_;
+        };
+    }
+}
@@ -0,0 +1,122 @@
+#pragma once
+// 按调用点对日志进行限流、采样和重复抑制，依赖故障时热循环中的同一个Error()不会刷出上百万条相同日志，
+// 也就不会每条都走一遍vasprintf、远程备份和fsync。每个调用点对应一个静态的CallSiteLimiter，
+// 判断过程只使用原子变量，不加锁
+#include <atomic>
+#include <cstdint>
+#include <cstdio>
+#include <cstdarg>
+#include <ctime>
+#include <string>
+
+namespace mylog {
+    // LOG_DEDUP格式化后的内容，通常放在栈上的local中，超过local长度时放在heap中
+    struct DedupText {
+        char local[1024];
+        std::string heap;
+        const char *data = local;
+    };
+
+    class CallSiteLimiter {
+        public:
+            // 粗粒度单调时钟，毫秒
+            static int64_t NowMs() {
+                struct timespec ts;
+                clock_gettime(CLOCK_MONOTONIC_COARSE, &ts);
+                return static_cast<int64_t>(ts.tv_sec) * 1000 + ts.tv_nsec / 1000000;
+            }
+
+            // 每n次调用放行一次
+            bool EveryN(uint64_t n) {
+                if(n <= 1) return true;
+                return calls_.fetch_add(1, std::memory_order_relaxed) % n == 0;
+            }
+
+            // 每秒最多放行per_sec次，超出的部分计入suppressed_。
+            // 所在的秒和秒内计数打包在同一个64位原子变量里(高32位为秒，低32位为计数)，换秒和计数由同一次CAS完成，
+            // 不会出现一个线程清零时丢掉其他线程计数的情况；超限后只读不写
+            bool RateLimit(uint64_t per_sec) {
+                uint64_t now = static_cast<uint64_t>(NowMs() / 1000) & 0xffffffffULL;
+                uint64_t cur = rate_.load(std::memory_order_relaxed);
+                while(true) {
+                    uint64_t window = cur >> 32, count = cur & 0xffffffffULL;
+                    uint64_t next;
+                    if(now > window) {
+                        next = (now << 32) | 1; // 新的一秒，本次调用是第一次
+                    } else if(count < per_sec) {
+                        next = cur + 1; // 读到的时间比当前窗口旧时也计入当前窗口
+                    } else {
+                        suppressed_.fetch_add(1, std::memory_order_relaxed);
+                        return false;
+                    }
+                    if(rate_.compare_exchange_weak(cur, next, std::memory_order_relaxed)) return true;
+                }
+            }
+
+            // 以probability的概率放行，线程私有的xorshift随机数，无共享状态
+            static bool Sample(double probability) {
+                if(probability >= 1.0) return true;
+                if(probability <= 0.0) return false;
+                static thread_local uint64_t state = 0x9E3779B97F4A7C15ULL ^ reinterpret_cast<uintptr_t>(&state);
+                state ^= state << 13;
+                state ^= state >> 7;
+                state ^= state << 17;
+                return (state >> 11) * (1.0 / 9007199254740992.0) < probability;
+            }
+
+            // 重复抑制：window_ms内与上一条内容(hash)相同的日志只计数不输出，
+            // 返回true表示应当输出，*repeats为此前被抑制的次数，非0时调用者先输出一条"重复N次"的汇总
+            bool Dedup(uint64_t hash, int64_t window_ms, uint64_t *repeats) {
+                int64_t now = NowMs();
+                if(last_hash_.load(std::memory_order_relaxed) == hash &&
+                   now - last_emit_.load(std::memory_order_relaxed) < window_ms) {
+                    suppressed_.fetch_add(1, std::memory_order_relaxed);
+                    return false;
+                }
+                last_hash_.store(hash, std::memory_order_relaxed);
+                last_emit_.store(now, std::memory_order_relaxed);
+                *repeats = suppressed_.exchange(0, std::memory_order_relaxed);
+                return true;
+            }
+
+            // 取出并清零被抑制的次数，用于在下一条放行的日志前输出汇总
+            uint64_t TakeSuppressed() {
+                if(suppressed_.load(std::memory_order_relaxed) == 0) return 0;
+                return suppressed_.exchange(0, std::memory_order_relaxed);
+            }
+
+            // 格式化并计算FNV-1a哈希，重复抑制需要先知道内容是否相同。
+            // 先写入栈上的缓冲区，vsnprintf报告被截断时再按实际长度在堆上格式化一次，内容不会被截断
+            static uint64_t Format(DedupText *text, const char *format, ...) {
+                va_list va, copy;
+                va_start(va, format);
+                va_copy(copy, va);
+                int n = vsnprintf(text->local, sizeof(text->local), format, va);
+                va_end(va);
+                text->data = text->local;
+                if(n < 0) {
+                    text->local[0] = '\0';
+                    n = 0;
+                } else if(static_cast<size_t>(n) >= sizeof(text->local)) {
+                    text->heap.resize(n + 1);
+                    vsnprintf(&text->heap[0], n + 1, format, copy);
+                    text->heap.resize(n);
+                    text->data = text->heap.c_str();
+                }
+                va_end(copy);
+                uint64_t hash = 1469598103934665603ULL;
+                for(int i = 0; i < n; i++) {
+                    hash ^= static_cast<unsigned char>(text->data[i]);
+                    hash *= 1099511628211ULL;
+                }
+                return hash;
+            }
+
+        private:
+            std::atomic<uint64_t> calls_{0}; // EveryN的调用计数
+            std::atomic<uint64_t> rate_{0}; // RateLimit当前所在的秒(高32位)和秒内放行的次数(低32位)
+            std::atomic<uint64_t> suppressed_{0}; // 被抑制的次数
+            std::atomic<uint64_t> last_hash_{0}; // 上一条输出日志的内容哈希
+            std::atomic<int64_t> last_emit_{0}; // 上一条输出日志的时间
+    };
+}
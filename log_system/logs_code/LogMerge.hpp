@@ -0,0 +1,176 @@
+#pragma once
+// 多分片日志的合并：每条日志写入分片缓冲区时带上日志器内全局递增的序号，序号在分片的锁内分配，
+// 所以每个分片内部的记录按序号有序；落地前对各分片做k路归并，按序号输出。
+// STRICT模式下只输出连续的序号，缺失的序号还在其他分片的缓冲区里时等待；
+// BOUNDED模式下待输出的记录超过窗口大小就不再等待缺失的序号，但只输出比最小的未输出序号大不到窗口的记录，
+// 所以任何一条记录在输出中最多落后于它前面的记录window个序号；缺失的记录迟迟不到时(分片还没有写出)，
+// 超出窗口的记录继续等待，待输出的记录数可能超过窗口
+#include <vector>
+#include <cstring>
+#include <string>
+#include <algorithm>
+#include <functional>
+#include <cstdint>
+#include <sys/uio.h>
+#include "AsyncBuffer.hpp"
+
+namespace mylog {
+    enum class OrderType { UNORDERED, STRICT, BOUNDED }; // 多分片时的输出顺序
+
+    // 分片缓冲区中每条日志前面的头部
+    struct RecordHeader {
+        uint64_t seq; // 序号
+        uint64_t len; // 日志长度，不含头部
+    };
+
+    class LogMerger {
+        public:
+            LogMerger(size_t shards, OrderType type, size_t window)
+                : shards_(shards), type_(type), window_(window), done_(std::max<size_t>(window, 1), false) {}
+
+            // 解析分片一批缓冲区中的记录，缓冲区在回调返回后会被复用，所以日志内容拷贝到分片自己的存储中：
+            // 整批按段拷贝后原地去掉头部，使同一分片的相邻记录在内存中连续
+            void Add(size_t shard, Buffer &buffer) {
+                Shard &s = shards_[shard];
+                bool was_empty = s.Empty();
+                size_t start = s.arena.size();
+                buffer.GetIovec(&scratch_);
+                for(auto &v : scratch_) {
+                    s.arena.append(static_cast<const char*>(v.iov_base), v.iov_len);
+                }
+                char *p = &s.arena[0];
+                size_t rd = start, wr = start, end = s.arena.size();
+                RecordHeader h;
+                while(end - rd >= sizeof(h)) {
+                    memcpy(&h, p + rd, sizeof(h));
+                    rd += sizeof(h);
+                    if(h.len > end - rd) break; // 写入时内存不足导致的残缺记录
+                    memmove(p + wr, p + rd, h.len);
+                    s.recs.push_back(Record{h.seq, s.base + wr, h.len});
+                    rd += h.len;
+                    wr += h.len;
+                    ++pending_;
+                }
+                s.arena.resize(wr);
+                if(was_empty && !s.Empty()) PushHead(shard);
+            }
+
+            // 按序号取出可以输出的记录，相邻的记录合并成一个iovec；all为true时不再等待缺失的序号。
+            // iov指向内部存储，写出后调用Release，在此之前不能调用Add
+            void Collect(std::vector<struct iovec> *iov, bool all) {
+                iov->clear();
+                while(!heap_.empty()) {
+                    if(!Ready(heap_.front().first, all)) break;
+                    size_t shard = heap_.front().second;
+                    std::pop_heap(heap_.begin(), heap_.end(), std::greater<Head>());
+                    heap_.pop_back();
+                    // 分片内有序，只要下一条仍然比其他分片的队首小就继续输出，不经过堆
+                    Shard &s = shards_[shard];
+                    do {
+                        const Record &rec = s.recs[s.head++];
+                        --pending_;
+                        next_ = std::max(next_, rec.seq + 1);
+                        MarkDone(rec.seq);
+                        char *data = &s.arena[rec.off - s.base];
+                        if(!iov->empty() && static_cast<char*>(iov->back().iov_base) + iov->back().iov_len == data) {
+                            iov->back().iov_len += rec.len;
+                        } else {
+                            struct iovec v;
+                            v.iov_base = data;
+                            v.iov_len = rec.len;
+                            iov->push_back(v);
+                        }
+                    } while(!s.Empty() && (heap_.empty() || s.recs[s.head].seq < heap_.front().first) &&
+                            Ready(s.recs[s.head].seq, all));
+                    if(!s.Empty()) PushHead(shard);
+                }
+            }
+
+            // 回收已经输出的记录占用的存储，已输出部分超过一半时才移动剩余数据
+            void Release() {
+                for(auto &s : shards_) {
+                    if(s.Empty()) {
+                        s.recs.clear();
+                        s.head = 0;
+                    } else if(s.head * 2 >= s.recs.size()) {
+                        s.recs.erase(s.recs.begin(), s.recs.begin() + s.head);
+                        s.head = 0;
+                    }
+                    size_t cut = s.Empty() ? s.arena.size() : s.recs[s.head].off - s.base;
+                    if(cut == 0) continue;
+                    if(cut == s.arena.size()) {
+                        s.arena.clear();
+                    } else if(cut * 2 >= s.arena.size()) {
+                        s.arena.erase(0, cut);
+                    } else {
+                        continue;
+                    }
+                    s.base += cut;
+                }
+            }
+
+            // 等待输出的记录数
+            size_t Pending() {
+                return pending_;
+            }
+
+        private:
+            using Head = std::pair<uint64_t, size_t>; // 分片队首记录的序号和分片下标
+
+            struct Record {
+                uint64_t seq;
+                uint64_t off; // 在分片存储中的绝对偏移
+                uint64_t len;
+            };
+
+            struct Shard {
+                std::string arena; // 已解析、未输出的日志内容
+                uint64_t base = 0; // arena[0]的绝对偏移
+                std::vector<Record> recs; // 按序号有序，[head, size)尚未输出
+                size_t head = 0;
+
+                bool Empty() const {
+                    return head == recs.size();
+                }
+            };
+
+            // 序号为seq的记录现在能否输出：是最小的未输出序号；BOUNDED模式下已经跳过它输出了更大的序号
+            // (迟到的记录)，或者待输出的记录超过窗口且与最小的未输出序号相差不到窗口
+            bool Ready(uint64_t seq, bool all) const {
+                if(all || seq <= low_) return true;
+                if(type_ != OrderType::BOUNDED) return false;
+                return seq < next_ || (pending_ > window_ && seq - low_ < window_);
+            }
+
+            // 记下seq已经输出，并推进最小的未输出序号；只有all为true时才会超出位图范围，此时跳过的序号不再等待
+            void MarkDone(uint64_t seq) {
+                if(seq < low_) return;
+                while(seq - low_ >= done_.size()) {
+                    done_[low_ % done_.size()] = false;
+                    ++low_;
+                }
+                done_[seq % done_.size()] = true;
+                while(done_[low_ % done_.size()]) {
+                    done_[low_ % done_.size()] = false;
+                    ++low_;
+                }
+            }
+
+            void PushHead(size_t shard) {
+                const Shard &s = shards_[shard];
+                heap_.push_back(Head(s.recs[s.head].seq, shard));
+                std::push_heap(heap_.begin(), heap_.end(), std::greater<Head>());
+            }
+
+        private:
+            std::vector<Shard> shards_;
+            std::vector<Head> heap_; // 每个非空分片的队首，小顶堆
+            std::vector<struct iovec> scratch_; // Add中读取缓冲区用
+            OrderType type_;
+            size_t window_; // BOUNDED模式下最多等待的记录数
+            size_t pending_ = 0;
+            uint64_t next_ = 0; // 已输出的最大序号加1
+            uint64_t low_ = 0; // 最小的未输出序号
+            std::vector<bool> done_; // [low_, low_ + size)中已输出的序号，按序号取模存放
+    };
+}
@@ -1,53 +1,243 @@
+#pragma once
 #include <unordered_map>
+#include <atomic>
+#include <cstdint>
+#include <chrono>
+#include <csignal>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <vector>
+#include <thread>
+#include <fcntl.h>
+#include <unistd.h>
 #include "AsyncLogger.hpp"
 
 namespace mylog {
     //通过单例对象对日志器进行管理，懒汉模式
     class LoggerManager {
+            using LoggerMap = std::unordered_map<std::string, AsyncLogger::ptr>;
         public:
             static LoggerManager &GetInstance() {
                 static LoggerManager eton;
                 return eton;
             }
 
+            // 查询和获取日志器不加锁：读取线程私有的快照，只有注册表发生变化后才重新加载一次
             bool LoggerExist(const std::string &name) {
-                std::unique_lock<std::mutex> lock(mtx_);
-                auto it = loggers_.find(name);
-                if(it == loggers_.end()) {
-                    return false;
-                }
-                return true;
+                const LoggerMap &loggers = Snapshot();
+                return loggers.find(name) != loggers.end();
             }
 
+            // 检查和插入在同一把写锁内完成，两个线程同时添加同名日志器时只有一个生效
             void AddLogger(const AsyncLogger::ptr &&AsyncLogger) {
-                if(LoggerExist(AsyncLogger->Name())) return;
                 std::unique_lock<std::mutex> lock(mtx_);
-                loggers_.insert(std::make_pair(AsyncLogger->Name(), AsyncLogger));
+                auto current = std::atomic_load(&loggers_);
+                if(current->count(AsyncLogger->Name())) return;
+                std::shared_ptr<LoggerMap> next = std::make_shared<LoggerMap>(*current); // 写时复制
+                next->insert(std::make_pair(AsyncLogger->Name(), AsyncLogger));
+                Publish(next);
             }
 
-            AsyncLogger::ptr GetLogger(const std::string &name) {
+            void RemoveLogger(const std::string &name) {
                 std::unique_lock<std::mutex> lock(mtx_);
-                auto it = loggers_.find(name);
-                if(it == loggers_.end()) 
+                auto current = std::atomic_load(&loggers_);
+                if(current->count(name) == 0) return;
+                std::shared_ptr<LoggerMap> next = std::make_shared<LoggerMap>(*current);
+                next->erase(name);
+                Publish(next);
+            }
+
+            AsyncLogger::ptr GetLogger(const std::string &name) {
+                const LoggerMap &loggers = Snapshot();
+                auto it = loggers.find(name);
+                if(it == loggers.end()) 
                     return AsyncLogger::ptr();
                 return it->second;
             }
+
+            // 注册表版本号，每次添加或删除日志器后加一
+            uint64_t Version() {
+                return version_.load(std::memory_order_acquire);
+            }
             
             AsyncLogger::ptr DefaultLogger() {
                 return default_logger_;
             }
 
+            // 等待所有日志器此前写入的日志落地，所有日志器共用timeout_ms的期限，超时返回false
+            bool Flush(int timeout_ms) {
+                auto deadline = AsyncWorker::Clock::now() + std::chrono::milliseconds(timeout_ms);
+                auto loggers = std::atomic_load(&loggers_);
+                bool ok = true;
+                for(auto &it : *loggers) {
+                    ok = it.second->Drain(deadline) && ok;
+                }
+                return ok;
+            }
+
+            // 落地剩余日志并停止所有日志器，之后清空注册表；超过期限的日志器放弃等待，返回false。
+            // 超时的日志器异步线程还在运行，放进永不释放的列表里，避免随注册表一起被析构
+            bool Shutdown(int timeout_ms) {
+                auto deadline = AsyncWorker::Clock::now() + std::chrono::milliseconds(timeout_ms);
+                std::unique_lock<std::mutex> lock(mtx_);
+                auto loggers = std::atomic_load(&loggers_);
+                bool ok = true;
+                for(auto &it : *loggers) {
+                    if(!it.second->Stop(deadline)) {
+                        Abandoned().push_back(it.second);
+                        ok = false;
+                    }
+                }
+                Publish(std::make_shared<LoggerMap>());
+                return ok;
+            }
+
+            // 进程正常退出(exit/从main返回)时调用Shutdown。
+            // SIGTERM的处理函数只向管道写一个字节，由专门的线程读到后在普通线程上下文中Shutdown，
+            // 再按默认方式处理SIGTERM；期间再次收到SIGTERM立即按默认方式退出。
+            // SIGSEGV等同步的致命信号只能在出错的线程上处理，处理函数里尽力Flush：这不是异步信号安全的，
+            // 出错的线程如果正持有日志器的锁(如Push中)会死锁，timeout_ms只限制等待异步线程的时间，不限制加锁
+            void InstallExitHandlers(int timeout_ms) {
+                ExitTimeout() = timeout_ms;
+                static std::once_flag once;
+                std::call_once(once, []() {
+                    atexit(&LoggerManager::OnExit);
+                    struct sigaction sa;
+                    memset(&sa, 0, sizeof(sa));
+                    sa.sa_handler = &LoggerManager::OnSignal;
+                    sigemptyset(&sa.sa_mask);
+                    sa.sa_flags = SA_RESETHAND; // 处理一次后恢复默认行为
+                    int signals[] = {SIGSEGV, SIGABRT, SIGBUS, SIGFPE, SIGILL};
+                    for(int sig : signals) {
+                        if(sigaction(sig, &sa, NULL) < 0) {
+                            perror("sigaction failed");
+                        }
+                    }
+                    if(pipe2(TermPipe(), O_CLOEXEC) < 0) {
+                        perror("pipe2 failed");
+                        return;
+                    }
+                    std::thread(&LoggerManager::TermThreadEntry).detach();
+                    sa.sa_handler = &LoggerManager::OnTerm;
+                    if(sigaction(SIGTERM, &sa, NULL) < 0) {
+                        perror("sigaction failed");
+                    }
+                });
+            }
+
         private:
             LoggerManager() {
                 std::unique_ptr<LoggerBuilder> builder(new LoggerBuilder());
                 builder->BuildLoggerName("default");
                 default_logger_ = builder->Build();
-                loggers_.insert(std::make_pair("default", default_logger_));
+                std::shared_ptr<LoggerMap> loggers = std::make_shared<LoggerMap>();
+                loggers->insert(std::make_pair("default", default_logger_));
+                loggers_ = loggers;
+            }
+
+            // 退出和信号处理时落地日志的期限
+            static std::atomic<int> &ExitTimeout() {
+                static std::atomic<int> timeout_ms{1000};
+                return timeout_ms;
+            }
+
+            static void OnExit() {
+                GetInstance().Shutdown(ExitTimeout());
+            }
+
+            // 超时后仍在运行的日志器，进程退出前一直保持存活
+            static std::vector<AsyncLogger::ptr> &Abandoned() {
+                static std::vector<AsyncLogger::ptr> *loggers = new std::vector<AsyncLogger::ptr>;
+                return *loggers;
+            }
+
+            // SIGTERM通知管道，[0]读端，[1]写端
+            static int *TermPipe() {
+                static int fds[2] = {-1, -1};
+                return fds;
+            }
+
+            // 只调用异步信号安全的write
+            static void OnTerm(int) {
+                int saved = errno;
+                char c = 0;
+                ssize_t ret = write(TermPipe()[1], &c, 1);
+                (void)ret;
+                errno = saved;
+            }
+
+            static void TermThreadEntry() {
+                char c;
+                ssize_t n;
+                do {
+                    n = read(TermPipe()[0], &c, 1);
+                } while(n < 0 && errno == EINTR);
+                if(n != 1) return;
+                GetInstance().Shutdown(ExitTimeout());
+                signal(SIGTERM, SIG_DFL);
+                kill(getpid(), SIGTERM);
+            }
+
+            static void OnSignal(int sig) {
+                static std::atomic<bool> handling{false};
+                if(!handling.exchange(true)) { // 落地过程中再次崩溃时不重复进入
+                    GetInstance().Flush(ExitTimeout());
+                }
+                signal(sig, SIG_DFL);
+                raise(sig);
+            }
+
+            // 发布新的快照，调用者持有mtx_
+            void Publish(const std::shared_ptr<LoggerMap> &next) {
+                std::atomic_store(&loggers_, std::shared_ptr<const LoggerMap>(next));
+                version_.fetch_add(1, std::memory_order_release);
+            }
+
+            // 线程私有的快照缓存，版本号没变时直接使用，整个过程只有一次原子读
+            const LoggerMap &Snapshot() {
+                struct Cache {
+                    uint64_t version = UINT64_MAX;
+                    std::shared_ptr<const LoggerMap> loggers;
+                };
+                static thread_local Cache cache;
+                uint64_t version = version_.load(std::memory_order_acquire);
+                if(cache.version != version) {
+                    cache.loggers = std::atomic_load(&loggers_);
+                    cache.version = version;
+                }
+                return *cache.loggers;
             }
 
         private:
-            std::mutex mtx_;
+            std::mutex mtx_; // 只用于串行化写操作
+            std::atomic<uint64_t> version_{0};
             AsyncLogger::ptr default_logger_;  // 默认日志器
-            std::unordered_map<std::string, AsyncLogger::ptr> loggers_; // 存放日志器
+            std::shared_ptr<const LoggerMap> loggers_; // 存放日志器的只读快照，写时复制后整体替换
+    };
+
+    // 线程私有的日志器句柄，缓存查找结果，注册表版本变化后才重新查找，
+    // 用法: static thread_local mylog::LoggerHandle logger("asynclogger"); logger->Info(...);
+    class LoggerHandle {
+        public:
+            explicit LoggerHandle(const std::string &name) : name_(name) {}
+
+            const AsyncLogger::ptr &Get() {
+                uint64_t version = LoggerManager::GetInstance().Version();
+                if(version != version_ || !logger_) {
+                    logger_ = LoggerManager::GetInstance().GetLogger(name_);
+                    version_ = version;
+                }
+                return logger_;
+            }
+
+            AsyncLogger *operator->() {
+                return Get().get();
+            }
+
+        private:
+            std::string name_;
+            uint64_t version_ = UINT64_MAX;
+            AsyncLogger::ptr logger_;
     };
 }
\ No newline at end of file
@@ -15,7 +15,8 @@ namespace mylog {
               payload_(payload),
               level_(level),
               line_(line),
-              ctime_(Util::Date::Now()),
+              ctime_ns_(Util::Date::NowNs()),
+              ctime_(static_cast<time_t>(ctime_ns_ / 1000000000)),
               tid_(std::this_thread::get_id()) {}
               
         std::string format() {
@@ -24,7 +25,8 @@ namespace mylog {
             struct tm t;
             localtime_r(&ctime_, &t);
             char buf[128];
-            strftime(buf, sizeof(buf), "%H:%M:%S", &t);
+            size_t n = strftime(buf, sizeof(buf), "%H:%M:%S", &t);
+            snprintf(buf + n, sizeof(buf) - n, ".%06d", static_cast<int>(ctime_ns_ % 1000000000 / 1000)); // 微秒
             std::string tmp1 = '[' + std::string(buf) + "][";
             std::string tmp2 = '[' + std::string(LogLevel::ToString(level_)) + "][" + name_ + "][" + file_name_ + ":"
                                    + std::to_string(line_) + "]\t"
@@ -35,7 +37,8 @@ namespace mylog {
         }
 
         size_t line_;  // 行号
-        time_t ctime_; // 时间
+        int64_t ctime_ns_; // 纳秒级时间戳
+        time_t ctime_; // 时间(秒)
         std::string file_name_; //文件名
         std::string name_; // 日志器名
         std::string payload_; //信息体
@@ -1,5 +1,6 @@
 #pragma once
 #include "Manager.hpp"
+#include "LogLimiter.hpp"
 // namespace mylog
 namespace mylog {
     // 获取日志器
@@ -10,19 +11,62 @@ namespace mylog {
     AsyncLogger::ptr DefaultLogger() {
         return LoggerManager::GetInstance().DefaultLogger();
     }
+    // 等待所有日志器已写入的日志落地，最多等待timeout_ms毫秒
+    bool FlushAll(int timeout_ms) {
+        return LoggerManager::GetInstance().Flush(timeout_ms);
+    }
+    // 落地剩余日志并停止所有日志器，程序退出前调用
+    bool Shutdown(int timeout_ms) {
+        return LoggerManager::GetInstance().Shutdown(timeout_ms);
+    }
 
     // 简化用户使用，宏函数默认填上文件名+行号
-    #define Debug(fmt, ...) Debug(__FILE__, __LINE__, fmt, ##__VA__ARGS__)
-    #define Info(fmt, ...) Info(__FILE__, __LINE__, fmt, ##__VA__ARGS__)
-    #define Warn(fmt, ...) Warn(__FILE__, __LINE__, fmt, ##__VA__ARGS__)
-    #define Error(fmt, ...) Error(__FILE__, __LINE__, fmt, ##__VA__ARGS__)
-    #define Fatal(fmt, ...) Fatal(__FILE__, __LINE__, fmt, ##__VA__ARGS__)
+    #define Debug(fmt, ...) Debug(__FILE__, __LINE__, fmt, ##__VA_ARGS__)
+    #define Info(fmt, ...) Info(__FILE__, __LINE__, fmt, ##__VA_ARGS__)
+    #define Warn(fmt, ...) Warn(__FILE__, __LINE__, fmt, ##__VA_ARGS__)
+    #define Error(fmt, ...) Error(__FILE__, __LINE__, fmt, ##__VA_ARGS__)
+    #define Fatal(fmt, ...) Fatal(__FILE__, __LINE__, fmt, ##__VA_ARGS__)
 
     // 无需获取日志器，默认标准输出
-    #define LOGDEBUGDEFAULT(fmt, ...) mylog::DefaultLogger()->Debug(fmt, ##__VA__ARGS__)
+    #define LOGDEBUGDEFAULT(fmt, ...) mylog::DefaultLogger()->Debug(fmt, ##__VA_ARGS__)
     #define LOGINFODEFAULT(fmt, ...) mylog::DefaultLogger()->Info(fmt, ##__VA_ARGS__)
     #define LOGWARNDEFAULT(fmt, ...) mylog::DefaultLogger()->Warn(fmt, ##__VA_ARGS__)
     #define LOGERRORDEFAULT(fmt, ...) mylog::DefaultLogger()->Error(fmt, ##__VA_ARGS__)
     #define LOGFATALDEFAULT(fmt, ...) mylog::DefaultLogger()->Fatal(fmt, ##__VA_ARGS__)
 
+    // 按调用点限流，level为Debug/Info/Warn/Error/Fatal，被抑制的日志不会进行格式化、备份和落盘
+    // 每n次调用输出一次
+    #define LOG_EVERY_N(logger, level, n, fmt, ...) do { \
+        static mylog::CallSiteLimiter mylog_site_; \
+        if(mylog_site_.EveryN(n)) (logger)->level(fmt, ##__VA_ARGS__); \
+    } while(0)
+
+    // 每秒最多输出per_sec条，恢复输出时先汇报被限流的条数
+    #define LOG_RATE_LIMIT(logger, level, per_sec, fmt, ...) do { \
+        static mylog::CallSiteLimiter mylog_site_; \
+        if(mylog_site_.RateLimit(per_sec)) { \
+            uint64_t mylog_repeats_ = mylog_site_.TakeSuppressed(); \
+            if(mylog_repeats_) (logger)->level("%lu messages suppressed by rate limit", (unsigned long)mylog_repeats_); \
+            (logger)->level(fmt, ##__VA_ARGS__); \
+        } \
+    } while(0)
+
+    // 以probability(0~1)的概率输出
+    #define LOG_SAMPLE(logger, level, probability, fmt, ...) do { \
+        if(mylog::CallSiteLimiter::Sample(probability)) (logger)->level(fmt, ##__VA_ARGS__); \
+    } while(0)
+
+    // window_ms内内容相同的日志只输出一次，之后合并为一条"重复N次"的记录；级别未开启时不做格式化
+    #define LOG_DEDUP(logger, level, window_ms, fmt, ...) do { \
+        static mylog::CallSiteLimiter mylog_site_; \
+        if(!(logger)->Enabled(mylog::LogLevel::level)) break; \
+        mylog::DedupText mylog_text_; \
+        uint64_t mylog_repeats_ = 0; \
+        uint64_t mylog_hash_ = mylog::CallSiteLimiter::Format(&mylog_text_, fmt, ##__VA_ARGS__); \
+        if(mylog_site_.Dedup(mylog_hash_, window_ms, &mylog_repeats_)) { \
+            if(mylog_repeats_) (logger)->level("last message repeated %lu times", (unsigned long)mylog_repeats_); \
+            (logger)->level("%s", mylog_text_.data); \
+        } \
+    } while(0)
+
 }
\ No newline at end of file
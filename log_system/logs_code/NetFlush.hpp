@@ -0,0 +1,387 @@
+#pragma once
+// 网络日志落地方向：通过一条长连接(TCP或Unix域套接字)把全部日志流式发送给日志汇聚端，
+// 而不只是CliBackupLog中每条ERROR/FATAL一次短连接的备份。
+// 每次Flush把消费者缓冲区打包成一个批次：定长批次头 + 数据，直接从调用者的iovec发出，不经过副本；
+// 消费者缓冲区在回调返回后会被复用，所以发送之后(不在发送路径上)再把还没确认的批次拷贝进重放窗口；
+// 接收端按批次序号回复确认(ack)，未确认的批次保存在有界的重放窗口中，断线重连后按顺序重发，接收端按序号去重。
+// 连接和发送都有超时，对端卡住时按断线处理，不会让异步线程无限阻塞。
+// 构造时用NetFlush::Tcp()或NetFlush::Unix()标明地址类型，如BuildLoggerFlush<NetFlush>(NetFlush::Tcp(), "127.0.0.1", 9000)。
+// 开启压缩时使用zlib，需要链接-lz
+#include <deque>
+#include <algorithm>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <cstring>
+#include <cerrno>
+#include <fcntl.h>
+#include <unistd.h>
+#include <poll.h>
+#include <endian.h>
+#include <sys/un.h>
+#include <sys/uio.h>
+#include <sys/socket.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <arpa/inet.h>
+#include <zlib.h>
+#include "logFlush.hpp"
+
+namespace mylog {
+    // 批次头，所有字段为网络字节序
+    struct NetBatchHeader {
+        uint32_t magic; // kMagic
+        uint32_t flags; // 第0位表示数据经过zlib压缩
+        uint64_t seq; // 批次序号，从1开始连续递增
+        uint32_t length; // 线上数据长度
+        uint32_t raw_length; // 压缩前长度
+    } __attribute__((packed));
+
+    // 网络发送的统计信息
+    struct NetFlushStats {
+        uint64_t batches = 0; // 发送的批次
+        uint64_t bytes = 0; // 线上发送的字节数(含重发)
+        uint64_t replayed = 0; // 重连后重发的批次
+        uint64_t dropped = 0; // 重放窗口满且等待超时后丢弃的批次
+        uint64_t copied = 0; // 为重放窗口拷贝的字节数(发送期间已经确认的批次不拷贝)
+        uint64_t reconnects = 0;
+    };
+
+    class NetFlush : public LogFlush {
+        public:
+            using ptr = std::shared_ptr<NetFlush>;
+            static const uint32_t kMagic = 0x4d4c4e42; // "MLNB"
+            static const uint32_t kFlagCompressed = 1;
+            static const int kConnectTimeoutMs = 1000; // 连接超时
+            static const int kSendTimeoutMs = 1000; // 发送超时(SO_SNDTIMEO)，超时按断线处理
+            static const size_t kSpareBuffers = 4;
+
+            // 地址类型标记，区分两个构造函数
+            struct Tcp {};
+            struct Unix {};
+
+            // TCP连接
+            NetFlush(Tcp, const std::string &addr, uint16_t port, bool compress = false,
+                     size_t window_bytes = 64 * 1024 * 1024)
+                : compress_(compress), window_bytes_(window_bytes) {
+                struct sockaddr_in *server = reinterpret_cast<struct sockaddr_in*>(&addr_);
+                server->sin_family = AF_INET;
+                server->sin_port = htons(port);
+                inet_aton(addr.c_str(), &(server->sin_addr));
+                addr_len_ = sizeof(struct sockaddr_in);
+            }
+
+            // Unix域套接字连接
+            NetFlush(Unix, const std::string &unix_path, bool compress = false,
+                     size_t window_bytes = 64 * 1024 * 1024)
+                : compress_(compress), window_bytes_(window_bytes) {
+                struct sockaddr_un *server = reinterpret_cast<struct sockaddr_un*>(&addr_);
+                server->sun_family = AF_UNIX;
+                strncpy(server->sun_path, unix_path.c_str(), sizeof(server->sun_path) - 1);
+                addr_len_ = sizeof(struct sockaddr_un);
+            }
+
+            ~NetFlush() {
+                Sync();
+                Disconnect();
+            }
+
+            // 尽量等待已发送批次的确认，最多等待1秒
+            void Sync() override {
+                auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(1);
+                while(sock_ >= 0 && !window_.empty() && std::chrono::steady_clock::now() < deadline) {
+                    WaitAck(100);
+                }
+            }
+
+            void Flush(const char *data, size_t len) override {
+                struct iovec iov;
+                iov.iov_base = const_cast<char*>(data);
+                iov.iov_len = len;
+                Flush(&iov, 1);
+            }
+
+            void Flush(const struct iovec *iov, int iovcnt) override {
+                size_t raw = 0;
+                for(int i = 0; i < iovcnt; i++) raw += iov[i].iov_len;
+                if(raw == 0) return;
+
+                Batch batch;
+                batch.seq = ++next_seq_;
+                batch.raw_length = raw;
+                if(compress_ && Compress(iov, iovcnt, raw, &batch.data)) {
+                    batch.compressed = true;
+                }
+                size_t wire = batch.compressed ? batch.data.size() : raw;
+                MakeRoom(wire);
+
+                bool sent = false;
+                if(EnsureConnected()) {
+                    // 不压缩时直接发送调用者的数据；压缩后的数据本来就在batch中
+                    sent = batch.compressed ? Send(batch) : Send(batch, iov, iovcnt);
+                    if(!sent) Disconnect();
+                    ReadAcks();
+                }
+                if(sent && batch.seq <= acked_) return; // 发送期间已经确认，不需要保存副本
+                if(!batch.compressed) {
+                    // 重放窗口的副本，复用已确认批次释放的内存
+                    if(!spare_.empty()) {
+                        batch.data.swap(spare_.back());
+                        spare_.pop_back();
+                    }
+                    batch.data.clear();
+                    batch.data.reserve(raw);
+                    for(int i = 0; i < iovcnt; i++) {
+                        batch.data.append(static_cast<const char*>(iov[i].iov_base), iov[i].iov_len);
+                    }
+                    stats_.copied += raw;
+                }
+                window_bytes_used_ += batch.data.size();
+                window_.push_back(std::move(batch));
+            }
+
+            NetFlushStats Stats() {
+                return stats_;
+            }
+
+        private:
+            struct Batch {
+                uint64_t seq = 0;
+                size_t raw_length = 0;
+                bool compressed = false;
+                std::string data;
+            };
+
+            bool Compress(const struct iovec *iov, int iovcnt, size_t raw, std::string *out) {
+                z_stream zs;
+                memset(&zs, 0, sizeof(zs));
+                if(deflateInit(&zs, Z_BEST_SPEED) != Z_OK) return false;
+                out->resize(deflateBound(&zs, raw));
+                zs.next_out = reinterpret_cast<Bytef*>(&(*out)[0]);
+                zs.avail_out = out->size();
+                for(int i = 0; i < iovcnt; i++) {
+                    zs.next_in = static_cast<Bytef*>(iov[i].iov_base);
+                    zs.avail_in = iov[i].iov_len;
+                    if(deflate(&zs, i + 1 == iovcnt ? Z_FINISH : Z_NO_FLUSH) == Z_STREAM_ERROR) {
+                        deflateEnd(&zs);
+                        return false;
+                    }
+                }
+                out->resize(zs.total_out);
+                deflateEnd(&zs);
+                return true;
+            }
+
+            // 发送批次头和batch中保存的数据，用于压缩后的批次和重放
+            bool Send(const Batch &batch) {
+                struct iovec data;
+                data.iov_base = const_cast<char*>(batch.data.data());
+                data.iov_len = batch.data.size();
+                return Send(batch, &data, 1);
+            }
+
+            // 发送批次头和iov中的数据，iov的总长度就是线上数据长度
+            bool Send(const Batch &batch, const struct iovec *iov, int iovcnt) {
+                size_t length = 0;
+                for(int i = 0; i < iovcnt; i++) length += iov[i].iov_len;
+                NetBatchHeader header;
+                header.magic = htonl(kMagic);
+                header.flags = htonl(batch.compressed ? kFlagCompressed : 0);
+                header.seq = htobe64(batch.seq);
+                header.length = htonl(static_cast<uint32_t>(length));
+                header.raw_length = htonl(static_cast<uint32_t>(batch.raw_length));
+
+                // SendAll会修改iovec，拷贝到成员数组中，不改动调用者的iov
+                vec_.resize(iovcnt + 1);
+                vec_[0].iov_base = &header;
+                vec_[0].iov_len = sizeof(header);
+                std::copy(iov, iov + iovcnt, vec_.begin() + 1);
+                size_t want = sizeof(header) + length;
+                if(SendAll(vec_.data(), vec_.size()) != want) return false;
+                ++stats_.batches;
+                stats_.bytes += want;
+                return true;
+            }
+
+            // 与WritevAll相同，但使用sendmsg + MSG_NOSIGNAL，对端断开时返回错误而不是触发SIGPIPE；
+            // 超过SO_SNDTIMEO仍发不出去时返回已发送的字节数，由调用者断开连接(批次可能只发了一部分)
+            size_t SendAll(struct iovec *iov, size_t iovcnt) {
+                size_t total = 0;
+                size_t idx = 0;
+                while(idx < iovcnt) {
+                    struct msghdr msg;
+                    memset(&msg, 0, sizeof(msg));
+                    msg.msg_iov = iov + idx;
+                    msg.msg_iovlen = std::min<size_t>(iovcnt - idx, IOV_MAX);
+                    ssize_t n = sendmsg(sock_, &msg, MSG_NOSIGNAL);
+                    if(n < 0) {
+                        if(errno == EINTR) continue;
+                        if(errno == EAGAIN || errno == EWOULDBLOCK) {
+                            std::cout << __FILE__ << __LINE__ << "send to server timed out" << std::endl;
+                        } else {
+                            std::cout << __FILE__ << __LINE__ << "send to server error: " << strerror(errno) << std::endl;
+                        }
+                        break;
+                    }
+                    total += n;
+                    while(idx < iovcnt && static_cast<size_t>(n) >= iov[idx].iov_len) {
+                        n -= iov[idx].iov_len;
+                        ++idx;
+                    }
+                    if(idx < iovcnt) {
+                        iov[idx].iov_base = static_cast<char*>(iov[idx].iov_base) + n;
+                        iov[idx].iov_len -= n;
+                    }
+                }
+                return total;
+            }
+
+            bool EnsureConnected() {
+                if(sock_ >= 0) return true;
+                // 连接失败后至少间隔1秒再重试，期间的批次只进入重放窗口
+                auto now = std::chrono::steady_clock::now();
+                if(now < next_retry_) return false;
+                next_retry_ = now + std::chrono::seconds(1);
+
+                sock_ = socket(reinterpret_cast<struct sockaddr*>(&addr_)->sa_family, SOCK_STREAM | SOCK_CLOEXEC, 0);
+                if(sock_ < 0) {
+                    std::cout << __FILE__ << __LINE__ << "create socket failed: " << strerror(errno) << std::endl;
+                    return false;
+                }
+                if(!Connect()) {
+                    close(sock_);
+                    sock_ = -1;
+                    return false;
+                }
+                struct timeval tv;
+                tv.tv_sec = kSendTimeoutMs / 1000;
+                tv.tv_usec = (kSendTimeoutMs % 1000) * 1000;
+                setsockopt(sock_, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+                if(reinterpret_cast<struct sockaddr*>(&addr_)->sa_family == AF_INET) {
+                    int on = 1;
+                    setsockopt(sock_, IPPROTO_TCP, TCP_NODELAY, &on, sizeof(on));
+                }
+                ++stats_.reconnects;
+                // 重连后按顺序重发所有未确认的批次
+                for(auto &b : window_) {
+                    if(!Send(b)) {
+                        Disconnect();
+                        return false;
+                    }
+                    ++stats_.replayed;
+                }
+                return true;
+            }
+
+            // 非阻塞connect，最多等待kConnectTimeoutMs，连上后恢复为阻塞模式
+            bool Connect() {
+                int flags = fcntl(sock_, F_GETFL, 0);
+                fcntl(sock_, F_SETFL, flags | O_NONBLOCK);
+                int ret = connect(sock_, reinterpret_cast<struct sockaddr*>(&addr_), addr_len_);
+                if(ret < 0 && errno == EINPROGRESS) {
+                    struct pollfd pfd = { sock_, POLLOUT, 0 };
+                    do {
+                        ret = poll(&pfd, 1, kConnectTimeoutMs);
+                    } while(ret < 0 && errno == EINTR);
+                    if(ret == 0) {
+                        std::cout << __FILE__ << __LINE__ << "connect timed out" << std::endl;
+                        return false;
+                    }
+                    int err = 0;
+                    socklen_t len = sizeof(err);
+                    if(ret > 0 && getsockopt(sock_, SOL_SOCKET, SO_ERROR, &err, &len) == 0) errno = err;
+                    ret = (ret > 0 && err == 0) ? 0 : -1;
+                }
+                if(ret < 0) {
+                    std::cout << __FILE__ << __LINE__ << "connect error: " << strerror(errno) << std::endl;
+                    return false;
+                }
+                fcntl(sock_, F_SETFL, flags);
+                return true;
+            }
+
+            void Disconnect() {
+                if(sock_ >= 0) {
+                    close(sock_);
+                    sock_ = -1;
+                }
+                ack_len_ = 0;
+            }
+
+            // 非阻塞读取所有已到达的确认，确认为8字节网络字节序的批次序号，表示该序号及之前的批次都已落地
+            void ReadAcks() {
+                while(sock_ >= 0) {
+                    ssize_t n = recv(sock_, ack_buf_ + ack_len_, sizeof(ack_buf_) - ack_len_, MSG_DONTWAIT);
+                    if(n == 0 || (n < 0 && errno != EAGAIN && errno != EWOULDBLOCK && errno != EINTR)) {
+                        Disconnect();
+                        return;
+                    }
+                    if(n < 0) return;
+                    ack_len_ += n;
+                    size_t off = 0;
+                    for(; off + sizeof(uint64_t) <= ack_len_; off += sizeof(uint64_t)) {
+                        uint64_t seq;
+                        memcpy(&seq, ack_buf_ + off, sizeof(seq));
+                        Acknowledge(be64toh(seq));
+                    }
+                    memmove(ack_buf_, ack_buf_ + off, ack_len_ - off);
+                    ack_len_ -= off;
+                }
+            }
+
+            void Acknowledge(uint64_t seq) {
+                if(seq > acked_) acked_ = seq;
+                while(!window_.empty() && window_.front().seq <= seq) {
+                    window_bytes_used_ -= window_.front().data.size();
+                    Recycle(&window_.front());
+                    window_.pop_front();
+                }
+            }
+
+            // 留下已确认批次的内存给之后的副本使用，避免每个批次都重新申请
+            void Recycle(Batch *batch) {
+                if(spare_.size() < kSpareBuffers && !batch->compressed) {
+                    spare_.push_back(std::move(batch->data));
+                }
+            }
+
+            // 等待timeout_ms毫秒内到达的确认
+            void WaitAck(int timeout_ms) {
+                if(sock_ < 0) return;
+                struct pollfd pfd = { sock_, POLLIN, 0 };
+                if(poll(&pfd, 1, timeout_ms) > 0) ReadAcks();
+            }
+
+            // 重放窗口满时先等待确认，最多等待1秒，仍然放不下则丢弃最旧的批次，避免日志线程无限阻塞
+            void MakeRoom(size_t len) {
+                auto deadline = std::chrono::steady_clock::now() + std::chrono::seconds(1);
+                while(!window_.empty() && window_bytes_used_ + len > window_bytes_) {
+                    if(sock_ >= 0 && std::chrono::steady_clock::now() < deadline) {
+                        WaitAck(100);
+                        continue;
+                    }
+                    window_bytes_used_ -= window_.front().data.size();
+                    Recycle(&window_.front());
+                    window_.pop_front();
+                    ++stats_.dropped;
+                }
+            }
+
+        private:
+            struct sockaddr_storage addr_ = {};
+            socklen_t addr_len_ = 0;
+            int sock_ = -1;
+            bool compress_;
+            size_t window_bytes_; // 重放窗口上限
+            size_t window_bytes_used_ = 0;
+            std::deque<Batch> window_; // 已发送未确认的批次
+            std::vector<std::string> spare_; // 已确认批次留下的内存，最多kSpareBuffers个
+            std::vector<struct iovec> vec_; // 发送时的批次头加数据
+            uint64_t next_seq_ = 0;
+            uint64_t acked_ = 0; // 收到的最大确认序号
+            char ack_buf_[4096];
+            size_t ack_len_ = 0;
+            std::chrono::steady_clock::time_point next_retry_;
+            NetFlushStats stats_;
+    };
+}
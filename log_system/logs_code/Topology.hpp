@@ -0,0 +1,210 @@
+#pragma once
+// CPU拓扑：记录每个NUMA节点包含哪些CPU，供异步线程绑核、内存段按节点分配、生产者按所在节点选择分片。
+// 节点划分优先取环境变量MYLOG_TOPOLOGY，格式为用分号隔开的CPU列表，如"0-3;4-7"表示两个节点，
+// 可以在单节点机器上模拟多节点；否则读取/sys/devices/system/node，都没有时视为一个节点。
+// 不在进程cpuset(sched_getaffinity)内的CPU会被去掉，没有可用CPU的节点也会被去掉。
+// 模拟的节点可以有重叠的CPU(如"0;0")，此时按CPU无法区分节点，生产者按线程轮流分到各节点；
+// 不重叠时(如"0;1")和真实拓扑一样按生产者当前所在的CPU选择节点
+#include <vector>
+#include <atomic>
+#include <string>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <sched.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/syscall.h>
+
+namespace mylog {
+    class Topology {
+        public:
+            static const int kAnyNode = -1; // 不绑定节点
+            static const int kPerNode = -2; // 每个节点一个分片，生产者写入本节点的分片
+
+            static Topology &GetInstance() {
+                static Topology topo;
+                return topo;
+            }
+
+            int NodeCount() const {
+                return static_cast<int>(nodes_.size());
+            }
+
+            const std::vector<int> &CpusOf(int node) const {
+                return nodes_[node].cpus;
+            }
+
+            // 节点划分来自MYLOG_TOPOLOGY时为true，此时不做mbind，只依靠绑核后的首次访问
+            bool Simulated() const {
+                return simulated_;
+            }
+
+            int NodeOfCpu(int cpu) const {
+                if(cpu < 0 || cpu >= static_cast<int>(cpu_node_.size())) return 0;
+                return cpu_node_[cpu];
+            }
+
+            // 当前线程所在的节点；sched_getcpu每256次调用才执行一次，线程迁移后最多滞后256次。
+            // 模拟节点的CPU有重叠时不看CPU，每个线程第一次调用时按顺序轮流分配一个节点，之后固定不变
+            int CurrentNode() const {
+                if(nodes_.size() == 1) return 0;
+                struct Cache {
+                    int node = 0;
+                    unsigned countdown = 0;
+                };
+                static thread_local Cache cache;
+                if(overlap_) {
+                    if(cache.countdown == 0) { // countdown只表示是否已经分配
+                        cache.node = static_cast<int>(next_thread_.fetch_add(1, std::memory_order_relaxed) % nodes_.size());
+                        cache.countdown = 1;
+                    }
+                    return cache.node;
+                }
+                if(cache.countdown-- == 0) {
+                    cache.node = NodeOfCpu(sched_getcpu());
+                    cache.countdown = 255;
+                }
+                return cache.node;
+            }
+
+            // 把当前线程绑定到节点的CPU上，之后该线程首次写入的内存页会分配在本节点
+            bool BindThread(int node) const {
+                if(node < 0 || node >= NodeCount()) return false;
+                cpu_set_t set;
+                CPU_ZERO(&set);
+                for(int cpu : nodes_[node].cpus) CPU_SET(cpu, &set);
+                int ret = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+                if(ret != 0) {
+                    errno = ret;
+                    perror("pthread_setaffinity_np failed");
+                    return false;
+                }
+                return true;
+            }
+
+            // 优先在节点上分配[addr, addr+len)的物理页，内存不足时允许落到其他节点；模拟拓扑下不做任何事
+            void BindMemory(void *addr, size_t len, int node) const {
+                if(simulated_ || node < 0 || node >= NodeCount() || NodeCount() == 1) return;
+#ifdef SYS_mbind
+                const int kMpolPreferred = 1;
+                unsigned long mask[16] = {0}; // 最多1024个物理节点
+                int phys = nodes_[node].phys_id;
+                if(phys >= static_cast<int>(sizeof(mask) * 8)) return;
+                mask[phys / (sizeof(unsigned long) * 8)] |= 1UL << (phys % (sizeof(unsigned long) * 8));
+                if(syscall(SYS_mbind, addr, len, kMpolPreferred, mask, sizeof(mask) * 8, 0) != 0) {
+                    perror("mbind failed");
+                }
+#endif
+            }
+
+        private:
+            struct Node {
+                int phys_id; // /sys中的节点编号，mbind使用
+                std::vector<int> cpus;
+            };
+
+            Topology() {
+                cpu_set_t allowed;
+                CPU_ZERO(&allowed);
+                if(sched_getaffinity(0, sizeof(allowed), &allowed) != 0) {
+                    for(int cpu = 0; cpu < CPU_SETSIZE; cpu++) CPU_SET(cpu, &allowed);
+                }
+                std::vector<std::vector<int>> lists;
+                std::vector<int> phys_ids;
+                const char *env = getenv("MYLOG_TOPOLOGY");
+                if(env != nullptr && env[0] != '\0') {
+                    simulated_ = true;
+                    std::string spec(env);
+                    size_t start = 0;
+                    while(start <= spec.size()) {
+                        size_t end = spec.find(';', start);
+                        if(end == std::string::npos) end = spec.size();
+                        lists.push_back(ParseCpuList(spec.substr(start, end - start)));
+                        phys_ids.push_back(static_cast<int>(phys_ids.size()));
+                        start = end + 1;
+                    }
+                } else {
+                    // 在线节点的编号可能不连续，如"0,2-3"
+                    for(int id : ParseCpuList(ReadLine("/sys/devices/system/node/online"))) {
+                        std::string line = ReadLine("/sys/devices/system/node/node" + std::to_string(id) + "/cpulist");
+                        if(line.empty()) continue;
+                        lists.push_back(ParseCpuList(line));
+                        phys_ids.push_back(id);
+                    }
+                }
+                for(size_t i = 0; i < lists.size(); i++) {
+                    Node node;
+                    node.phys_id = phys_ids[i];
+                    for(int cpu : lists[i]) {
+                        if(cpu < CPU_SETSIZE && CPU_ISSET(cpu, &allowed)) node.cpus.push_back(cpu);
+                    }
+                    if(!node.cpus.empty()) nodes_.push_back(node);
+                }
+                if(nodes_.empty()) {
+                    // 没有拓扑信息，所有可用CPU视为一个节点
+                    Node node;
+                    node.phys_id = 0;
+                    for(int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+                        if(CPU_ISSET(cpu, &allowed)) node.cpus.push_back(cpu);
+                    }
+                    nodes_.push_back(node);
+                }
+                // 同一个CPU出现在多个模拟节点中时归属第一个节点，并记下有重叠
+                for(size_t n = 0; n < nodes_.size(); n++) {
+                    for(int cpu : nodes_[n].cpus) {
+                        if(cpu >= static_cast<int>(cpu_node_.size())) cpu_node_.resize(cpu + 1, -1);
+                        if(cpu_node_[cpu] < 0) {
+                            cpu_node_[cpu] = static_cast<int>(n);
+                        } else if(cpu_node_[cpu] != static_cast<int>(n)) {
+                            overlap_ = true;
+                        }
+                    }
+                }
+                for(int &node : cpu_node_) {
+                    if(node < 0) node = 0;
+                }
+            }
+
+            static std::string ReadLine(const std::string &path) {
+                FILE *fs = fopen(path.c_str(), "r");
+                if(fs == NULL) return std::string();
+                char line[4096] = {0};
+                if(fgets(line, sizeof(line), fs) == NULL) line[0] = '\0';
+                fclose(fs);
+                return line;
+            }
+
+            // 解析"0-3,8,10-11"格式的CPU列表
+            static std::vector<int> ParseCpuList(const std::string &s) {
+                std::vector<int> cpus;
+                const char *p = s.c_str();
+                while(*p) {
+                    char *end;
+                    long lo = strtol(p, &end, 10);
+                    if(end == p) {
+                        ++p;
+                        continue;
+                    }
+                    long hi = lo;
+                    p = end;
+                    if(*p == '-') {
+                        hi = strtol(p + 1, &end, 10);
+                        p = end;
+                    }
+                    for(long cpu = lo; cpu <= hi && cpu < CPU_SETSIZE; cpu++) {
+                        cpus.push_back(static_cast<int>(cpu));
+                    }
+                }
+                return cpus;
+            }
+
+        private:
+            bool simulated_ = false;
+            bool overlap_ = false; // 有CPU同时属于多个节点，只会出现在模拟拓扑中
+            mutable std::atomic<unsigned> next_thread_{0}; // 节点有重叠时下一个线程分到的节点
+            std::vector<Node> nodes_; // 下标即本文件中使用的节点编号
+            std::vector<int> cpu_node_; // CPU编号到节点编号
+    };
+}
@@ -5,6 +5,12 @@
 #include <sys/types.h>
 #include <json/json.h>
 #include <ctime>
+#include <mutex>
+#include <atomic>
+#include <memory>
+#include <cstdlib>
+#include <arpa/inet.h>
+#include <netinet/in.h>
 using std::cout;
 using std::endl;
 
@@ -14,6 +20,12 @@ namespace mylog {
         public:
             // 设为静态成员函数，可以不创建实例直接调用，返回当前的时间戳
             static time_t Now() { return time(nullptr); }
+            // 纳秒级的当前时间(CLOCK_REALTIME)，经vDSO读取，不进入内核
+            static int64_t NowNs() {
+                struct timespec ts;
+                clock_gettime(CLOCK_REALTIME, &ts);
+                return static_cast<int64_t>(ts.tv_sec) * 1000000000 + ts.tv_nsec;
+            }
         };
 
         class File {
@@ -137,38 +149,155 @@ namespace mylog {
             }
         };
 
+        // 全局配置，支持运行时热加载：数值字段都是原子变量，热路径上直接读取，不加锁；
+        // 配置文件路径优先取环境变量MYLOG_CONFIG，其次是SetConfigPath()设置的路径
+        // 一次加载得到的完整配置。发布后不再修改，读者拿到的总是同一次加载的全部字段
+        struct Config {
+            size_t buffer_size = 0; // 缓冲区基础容量
+            size_t flush_log = 0; // 控制日志同步到磁盘的时机，默认是0，1调用fflush，2调用fsync
+            int log_level = 0; // 最低输出等级，对应LogLevel::value
+            int flush_interval_ms = 0; // 异步线程攒批等待的最长时间，0表示有数据立即处理
+            size_t thread_count = 0; // 备份线程池大小，只在启动时读取
+            std::string backup_addr; // 远程备份的地址
+            uint16_t backup_port = 0; // 远程备份的端口
+            uint64_t version = 0; // 配置版本号，每次发布后加一
+        };
+
         struct JsonData{
             static JsonData* GetJsonData() {
                 static JsonData* json_data = new JsonData;
                 return json_data;
             }
 
+            // 设置配置文件路径。在第一次GetJsonData()之前调用时只记录路径，首次加载时使用；
+            // 已经加载过时立即按新路径重新加载，返回Reload()的结果。
+            // 设置了环境变量MYLOG_CONFIG时始终以环境变量为准，这里设置的路径不生效
+            static bool SetConfigPath(const std::string &path) {
+                {
+                    std::unique_lock<std::mutex> lock(PathMutex());
+                    PathStorage() = path;
+                }
+                if(!Loaded()) return true;
+                return GetJsonData()->Reload();
+            }
+
+            static std::string ConfigPath() {
+                const char *env = getenv("MYLOG_CONFIG");
+                if(env != nullptr && env[0] != '\0') return env;
+                std::unique_lock<std::mutex> lock(PathMutex());
+                return PathStorage();
+            }
+
+            // 当前配置。每个线程缓存一份快照，版本号不变时只读一次原子变量；
+            // 返回的引用在本线程下一次调用Current()之前有效
+            const Config &Current() {
+                struct Cache {
+                    uint64_t version = 0;
+                    std::shared_ptr<const Config> config;
+                };
+                static thread_local Cache cache;
+                uint64_t v = version_.load(std::memory_order_acquire);
+                if(!cache.config || cache.version != v) {
+                    cache.config = std::atomic_load(&config_);
+                    cache.version = v;
+                }
+                return *cache.config;
+            }
+
+            // 发布一份新的配置，version由这里分配。进程内修改配置(如压测工具)也走这里：
+            // Config conf = g_conf_data->Current(); conf.log_level = 0; g_conf_data->Publish(conf);
+            void Publish(const Config &conf) {
+                std::unique_lock<std::mutex> lock(reload_mtx_);
+                PublishLocked(conf);
+            }
+
+            // 重新读取配置文件并发布新的快照，文件无法读取或内容不合法时保留原有配置
+            bool Reload() {
+                return Reload(ConfigPath());
+            }
+
+            bool Reload(const std::string &path) {
+                std::string content;
+                mylog::Util::File file;
+                if(file.GetContent(&content, path) == false) {
+                    cout << __FILE__ << __LINE__ << "open " << path << " failed" << endl;
+                    return false;
+                }
+                Json::Value root;
+                if(mylog::Util::JsonUtil::UnSerialize(content, &root) == false) { // 反序列化，把内容转成json value格式
+                    return false;
+                }
+                if(!root.isObject()) {
+                    cout << __FILE__ << __LINE__ << path << " is not a json object" << endl;
+                    return false;
+                }
+                std::unique_lock<std::mutex> lock(reload_mtx_); // 只串行化重新加载本身
+                std::shared_ptr<const Config> old = std::atomic_load(&config_);
+                Config conf = old ? *old : Config();
+                try {
+                    // 字段类型不对时jsoncpp抛出异常，这时整份配置都不生效
+                    if(root["buffer_size"].asInt64() > 0) conf.buffer_size = root["buffer_size"].asInt64();
+                    conf.flush_log = root["flush_log"].asInt64();
+                    conf.log_level = root["log_level"].asInt();
+                    conf.flush_interval_ms = root["flush_interval_ms"].asInt();
+                    conf.thread_count = root["thread_count"].asInt();
+                    conf.backup_addr = root["backup_addr"].asString();
+                    conf.backup_port = static_cast<uint16_t>(root["backup_port"].asInt());
+                } catch(const std::exception &e) {
+                    cout << __FILE__ << __LINE__ << "bad config " << path << ": " << e.what() << endl;
+                    return false;
+                }
+                PublishLocked(conf);
+                return true;
+            }
+
+            // 获取远程备份的地址，地址和端口来自同一份配置
+            void BackupTarget(struct sockaddr_in *server) {
+                const Config &conf = Current();
+                server->sin_family = AF_INET;
+                if(inet_aton(conf.backup_addr.c_str(), &server->sin_addr) == 0) {
+                    server->sin_addr.s_addr = htonl(INADDR_ANY);
+                }
+                server->sin_port = htons(conf.backup_port);
+            }
+
             private:
                 JsonData() {
-                    std::string content;
-                    mylog::Util::File file;
-                    if(file.GetContent(&content, "../../log_system/logs_code/config.conf") == false) {
+                    std::atomic_store(&config_, std::shared_ptr<const Config>(new Config()));
+                    if(Reload() == false) {
                         cout << __FILE__ << __LINE__ << "open config.conf failed" << endl;
                         perror(NULL);
                     }
-                    Json::Value root;
-                    mylog::Util::JsonUtil::UnSerialize(content, &root); // 反序列化，把内容转成json value格式
-                    buffer_size = root["buffer_size"].asInt64();
-                    threshold = root["threshold"].asInt64();
-                    linear_growth = root["linear_growth"].asInt64();
-                    flush_log = root["flush_log"].asInt64();
-                    backup_addr = root["backup_addr"].asString();
-                    backup_port = root["backup_port"].asInt();
-                    thread_count = root["thread_count"].asInt();
-                }
-            public:
-                size_t buffer_size; // 缓冲区基础容量
-                size_t threshold; // 倍数扩容阈值
-                size_t linear_growth; // 线性增长容量
-                size_t flush_log; // 控制日志同步到磁盘的时机，默认是0，1调用fflush，2调用fsync
-                std::string backup_addr;
-                uint16_t backup_port;
-                size_t thread_count;
+                    Loaded() = true;
+                }
+
+                // 调用者持有reload_mtx_。先发布快照再增加版本号，读者看到新版本号时一定能取到不旧于它的快照
+                void PublishLocked(const Config &conf) {
+                    std::shared_ptr<Config> next(new Config(conf));
+                    next->version = version_.load(std::memory_order_relaxed) + 1;
+                    std::atomic_store(&config_, std::shared_ptr<const Config>(std::move(next)));
+                    version_.fetch_add(1, std::memory_order_release);
+                }
+
+                // 单例是否已经构造(首次加载已经执行过)
+                static std::atomic<bool> &Loaded() {
+                    static std::atomic<bool> loaded{false};
+                    return loaded;
+                }
+
+                static std::mutex &PathMutex() {
+                    static std::mutex mtx;
+                    return mtx;
+                }
+
+                static std::string &PathStorage() {
+                    static std::string path = "../../log_system/logs_code/config.conf";
+                    return path;
+                }
+
+                std::mutex reload_mtx_;
+                std::shared_ptr<const Config> config_; // 当前配置，只通过atomic_load/atomic_store访问
+                std::atomic<uint64_t> version_{0}; // 与config_->version相同，读者用来判断缓存的快照是否过期
         };
     }
 }
\ No newline at end of file
@@ -20,9 +20,7 @@ void start_backup(const std::string &message) {
     }
     struct sockaddr_in server;
     memset(&server, 0, sizeof(server));
-    server.sin_family = AF_INET;
-    server.sin_port = htons(g_conf_data->backup_port);
-    inet_aton(g_conf_data->backup_addr.c_str(), &(server.sin_addr));
+    g_conf_data->BackupTarget(&server); // 备份地址可能被热加载修改，一次性读出地址和端口
 
     int cnt = 5;
     while( -1 == connect(sock, (struct sockaddr*)&server, sizeof(server))) {
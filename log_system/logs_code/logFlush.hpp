@@ -1,14 +1,21 @@
+#pragma once
 #include "Util.hpp"
+#include "LogIndex.hpp"
 #include <fstream>
 #include <unistd.h>
 #include <memory>
+#include <climits>
+#include <vector>
+#include <algorithm>
+#include <cerrno>
+#include <sys/uio.h>
 
 /*
 LogFlush：纯虚基类，定义日志写入接口 Flush(const char*, size_t)。
 
 StdoutFlush：把日志输出到标准输出流 std::cout。
 
-FileFlush：把日志追加写入单个文件，并根据 g_conf_data->flush_log 决定是否 fflush/fsync。
+FileFlush：把日志追加写入单个文件，并根据配置中的 flush_log 决定是否 fflush/fsync。
 
 RollFileFlush：支持按“最大文件大小”自动滚动到新文件，文件名包含时间戳 + 序号；在写入时同样有 fflush/fsync 策略。
 
@@ -23,6 +30,50 @@ namespace mylog{
             using ptr = std::shared_ptr<LogFlush>;
             virtual ~LogFlush() {}
             virtual void Flush(const char *data, size_t len) = 0; // 不同的写方式Flush的实现不同
+            // 分散写接口，缓冲区由多个内存段组成时一次写出，默认逐段调用Flush
+            virtual void Flush(const struct iovec *iov, int iovcnt) {
+                for(int i = 0; i < iovcnt; i++) {
+                    Flush(static_cast<const char*>(iov[i].iov_base), iov[i].iov_len);
+                }
+            }
+            // 把已经写出的数据同步到最终位置(磁盘、对端)，Drain和退出时由异步线程调用，默认什么都不做
+            virtual void Sync() {}
+
+        protected:
+            // 把iov全部写入fd，处理部分写入和IOV_MAX的限制，返回写入的字节数
+            static size_t WritevAll(int fd, const struct iovec *iov, int iovcnt) {
+                size_t total = 0;
+                std::vector<struct iovec> rest(iov, iov + iovcnt);
+                size_t idx = 0;
+                while(idx < rest.size()) {
+                    int cnt = static_cast<int>(std::min<size_t>(rest.size() - idx, IOV_MAX));
+                    ssize_t n = writev(fd, &rest[idx], cnt);
+                    if(n < 0) {
+                        if(errno == EINTR) continue;
+                        std::cout << __FILE__ << __LINE__ << "writev log file failed" << std::endl;
+                        perror(NULL);
+                        break;
+                    }
+                    total += n;
+                    // 跳过已经完整写出的段，调整写了一部分的段
+                    while(idx < rest.size() && static_cast<size_t>(n) >= rest[idx].iov_len) {
+                        n -= rest[idx].iov_len;
+                        ++idx;
+                    }
+                    if(idx < rest.size()) {
+                        rest[idx].iov_base = static_cast<char*>(rest[idx].iov_base) + n;
+                        rest[idx].iov_len -= n;
+                    }
+                }
+                return total;
+            }
+
+            // 按flush_log策略同步到磁盘，writev直接进入内核，所以1(fflush)无需额外处理
+            static void SyncPolicy(FILE *fs) {
+                if(g_conf_data->Current().flush_log == 2) {
+                    fsync(fileno(fs));
+                }
+            }
     };
 
     class StdoutFlush : public LogFlush {
@@ -31,6 +82,10 @@ namespace mylog{
             void Flush(const char* data, size_t len) override{
                 std::cout.write(data, len); // 你告诉它从 data 开始，写出 len 字节，不管中间有没有 \0
             }
+
+            void Sync() override {
+                std::cout.flush();
+            }
     };
 
     class FileFlush : public LogFlush {
@@ -54,16 +109,29 @@ namespace mylog{
                     std::cout << __FILE__ <<__LINE__ << "write log file failed" <<std::endl;
                     perror(NULL);
                 }
-                if(g_conf_data->flush_log == 1) {
+                size_t flush_log = g_conf_data->Current().flush_log; // 只读一次，热加载时本次写入按同一个策略处理
+                if(flush_log == 1) {
                     if(fflush(fs_) == EOF) {
                         std::cout << __FILE__ << __LINE__ << "ffulsh file failed" << std::endl;
                         perror(NULL);
                     }
-                } else if(g_conf_data->flush_log == 2) {
+                } else if(flush_log == 2) {
                     fflush(fs_);
                     fsync(fileno(fs_));
                 }
             }
+
+            void Flush(const struct iovec *iov, int iovcnt) override {
+                fflush(fs_); // 先把stdio中可能残留的数据写出，保证顺序
+                WritevAll(fileno(fs_), iov, iovcnt);
+                SyncPolicy(fs_);
+            }
+
+            void Sync() override {
+                if(fs_ == NULL) return;
+                fflush(fs_);
+                fsync(fileno(fs_));
+            }
         private:
             std::string filename_;
             FILE* fs_ = NULL;
@@ -72,13 +140,14 @@ namespace mylog{
     class RollFileFlush : public LogFlush{
         public:
             using ptr = std::shared_ptr<RollFileFlush>;
-            RollFileFlush(const std::string &filename, size_t max_size) 
-                : max_size_(max_size), basename_(filename) {
+            // with_index为true时，每个日志文件旁边额外写一个同名的.idx索引文件，供tools/log_search检索
+            RollFileFlush(const std::string &filename, size_t max_size, bool with_index = false) 
+                : max_size_(max_size), basename_(filename), with_index_(with_index) {
                 // 创建目录
                 Util::File::CreateDirectory(Util::File::Path(filename));
             }
 
-            void Flush(const char* data, size_t len) {
+            void Flush(const char* data, size_t len) override {
                 // 确认文件大小不满足滚动需求
                 InitLogFile();
                 // 向文件写入内容
@@ -88,17 +157,37 @@ namespace mylog{
                     perror(NULL);
                 }
                 cur_size_ += len;
-                if(g_conf_data->flush_log == 1) {
+                if(with_index_) index_.Append(data, len);
+                size_t flush_log = g_conf_data->Current().flush_log;
+                if(flush_log == 1) {
                     if(fflush(fs_)) {
                         std::cout << __FILE__ << __LINE__ << "fflush file failed" << std::endl;
                         perror(NULL);
                     }
-                }else if(g_conf_data->flush_log == 2) {
+                }else if(flush_log == 2) {
                     fflush(fs_);
                     fsync(fileno(fs_));
                 }
             }
 
+            void Flush(const struct iovec *iov, int iovcnt) override {
+                InitLogFile();
+                fflush(fs_);
+                cur_size_ += WritevAll(fileno(fs_), iov, iovcnt);
+                if(with_index_) {
+                    for(int i = 0; i < iovcnt; i++) {
+                        index_.Append(static_cast<const char*>(iov[i].iov_base), iov[i].iov_len);
+                    }
+                }
+                SyncPolicy(fs_);
+            }
+
+            void Sync() override {
+                if(fs_ == NULL) return;
+                fflush(fs_);
+                fsync(fileno(fs_));
+            }
+
         private:
             void InitLogFile() {
                 if(fs_==NULL || cur_size_ >= max_size_) {
@@ -113,6 +202,10 @@ namespace mylog{
                         perror(NULL);
                     }
                     cur_size_ = 0;
+                    if(with_index_) {
+                        fseek(fs_, 0, SEEK_END);
+                        index_.Open(filename + ".idx", ftell(fs_)); // 上一个文件的索引在这里收尾关闭
+                    }
                 }
             }
 
@@ -137,6 +230,8 @@ namespace mylog{
             size_t max_size_;
             std::string basename_;
             FILE* fs_ = NULL;
+            bool with_index_;
+            index::IndexWriter index_; // 当前日志文件的索引
     };
 
     class LogFlushFactory {
@@ -1,6 +1,46 @@
+// 编译: g++ -O2 -std=c++11 test.cpp -I/usr/include/jsoncpp -ljsoncpp -pthread -o test
+// 在本目录下运行，失败时返回非0
+#include <sys/time.h>
+#include <sys/resource.h>
 #include "ThreadPoll.hpp"
+#include "Mylog.hpp"
+
+mylog::Util::JsonData *g_conf_data;
+ThreadPool *tp;
+
+static double CpuSeconds() {
+    struct rusage ru;
+    getrusage(RUSAGE_SELF, &ru);
+    return ru.ru_utime.tv_sec + ru.ru_utime.tv_usec / 1e6 + ru.ru_stime.tv_sec + ru.ru_stime.tv_usec / 1e6;
+}
+
+// 日志器空闲时异步线程挂起在条件变量上，空闲1秒整个进程消耗的CPU时间应当接近0
+static bool TestIdleCpu() {
+    mylog::LoggerBuilder builder;
+    builder.BuildLoggerName("idle_test");
+    builder.BuildLoggerFlush<mylog::FileFlush>("/tmp/mylog_idle_test.log");
+    mylog::LoggerManager::GetInstance().AddLogger(builder.Build());
+    mylog::AsyncLogger::ptr logger = mylog::GetLogger("idle_test");
+    for(int i = 0; i < 1000; i++) {
+        logger->Info("idle test %d", i);
+    }
+    mylog::FlushAll(1000);
+
+    double start = CpuSeconds();
+    sleep(1);
+    double used = CpuSeconds() - start;
+    std::cout << "idle cpu: " << used * 1000 << "ms in 1s" << std::endl;
+    return used < 0.02;
+}
 
 int main() {
-    ThreadPool tp(10);
+    ThreadPool pool(10);
+    tp = &pool;
+    g_conf_data = mylog::Util::JsonData::GetJsonData();
+    if(!TestIdleCpu()) {
+        std::cout << __FILE__ << __LINE__ << " idle cpu test failed" << std::endl;
+        return 1;
+    }
+    mylog::Shutdown(1000);
     return 0;
-}
\ No newline at end of file
+}
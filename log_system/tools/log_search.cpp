@@ -0,0 +1,253 @@
+// 滚动日志检索工具：利用RollFileFlush(with_index=true)生成的.idx稀疏索引跳过不可能命中的块，
+// 日志文件通过mmap映射，剩余的块切分成任务由多个线程并行做子串匹配，结果按文件和偏移顺序输出。
+// 没有索引的文件整体参与扫描。
+// 编译: g++ -O2 -std=c++11 -msse2 log_search.cpp -I../logs_code -pthread -o log_search
+// 用法: log_search [-l 等级] [-n 日志器名] [-s 起始时间戳] [-u 结束时间戳] [-j 线程数] [-c] 模式串 文件...
+#include <iostream>
+#include <string>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <atomic>
+#include <cstring>
+#include <cstdlib>
+#include <climits>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "LogIndex.hpp"
+
+using namespace mylog::index;
+
+struct Options {
+    std::string pattern;
+    int level = -1; // -1表示不限等级
+    std::string logger;
+    int64_t since = 0;
+    int64_t until = INT64_MAX;
+    size_t threads = std::thread::hardware_concurrency();
+    bool count_only = false;
+    std::vector<std::string> files;
+};
+
+struct MappedFile {
+    std::string name;
+    const char *data = nullptr;
+    size_t size = 0;
+};
+
+// 一个扫描任务：某个文件中的一段连续区间，起止都在行边界上
+struct Task {
+    size_t file;
+    size_t begin;
+    size_t end;
+};
+
+static const size_t kTaskSize = 8 * 1024 * 1024; // 无索引时按8MB切分任务
+
+static bool MapFile(const std::string &name, MappedFile *mf) {
+    int fd = open(name.c_str(), O_RDONLY);
+    if(fd < 0) {
+        perror(name.c_str());
+        return false;
+    }
+    struct stat st;
+    fstat(fd, &st);
+    mf->name = name;
+    mf->size = st.st_size;
+    if(mf->size > 0) {
+        void *p = mmap(nullptr, mf->size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if(p == MAP_FAILED) {
+            perror("mmap");
+            close(fd);
+            return false;
+        }
+        madvise(p, mf->size, MADV_SEQUENTIAL);
+        mf->data = static_cast<const char*>(p);
+    }
+    close(fd);
+    return true;
+}
+
+// 读取索引，文件不存在或格式不对返回false
+static bool LoadIndex(const std::string &name, std::vector<BlockEntry> *blocks) {
+    FILE *fs = fopen((name + ".idx").c_str(), "rb");
+    if(fs == NULL) return false;
+    char magic[sizeof(kMagic)];
+    bool ok = fread(magic, 1, sizeof(magic), fs) == sizeof(magic) && memcmp(magic, kMagic, sizeof(kMagic)) == 0;
+    BlockEntry e;
+    while(ok && fread(&e, 1, sizeof(e), fs) == sizeof(e)) {
+        blocks->push_back(e);
+    }
+    fclose(fs);
+    return ok;
+}
+
+// 根据索引判断块是否可能包含目标日志
+static bool BlockMayMatch(const BlockEntry &b, const Options &opt, const std::vector<std::string> &tokens) {
+    if(b.max_time < opt.since || b.min_time > opt.until) return false;
+    if(opt.level >= 0 && (b.level_bits & (1u << opt.level)) == 0) return false;
+    if(!opt.logger.empty() && !BloomMayContain(b.bloom, opt.logger.data(), opt.logger.size())) return false;
+    for(auto &t : tokens) {
+        if(!BloomMayContain(b.bloom, t.data(), t.size())) return false;
+    }
+    return true;
+}
+
+// 把[begin, end)按行边界切成不超过kTaskSize的任务
+static void SplitRange(size_t file, const MappedFile &mf, size_t begin, size_t end, std::vector<Task> *tasks) {
+    while(begin < end) {
+        size_t cut = std::min(end, begin + kTaskSize);
+        if(cut < end) {
+            const char *nl = static_cast<const char*>(memchr(mf.data + cut, '\n', end - cut));
+            cut = nl ? (nl - mf.data) + 1 : end;
+        }
+        tasks->push_back(Task{file, begin, cut});
+        begin = cut;
+    }
+}
+
+static bool LineMatches(const char *line, size_t len, const Options &opt) {
+    if(opt.level < 0 && opt.logger.empty()) return true;
+    const char *name = nullptr, *payload = nullptr;
+    size_t name_len = 0, payload_len = 0;
+    int lv = ParseLine(line, len, &name, &name_len, &payload, &payload_len);
+    if(opt.level >= 0 && lv != opt.level) return false;
+    if(!opt.logger.empty() && (name == nullptr || opt.logger.compare(0, std::string::npos, name, name_len) != 0)) return false;
+    return true;
+}
+
+static size_t Scan(const MappedFile &mf, const Task &t, const Options &opt, std::string *out) {
+    size_t matches = 0;
+    const char *p = mf.data + t.begin;
+    const char *end = mf.data + t.end;
+    while(p < end) {
+        const char *hit = FindSubstr(p, end - p, opt.pattern.data(), opt.pattern.size());
+        if(hit == nullptr) break;
+        const char *line = hit;
+        while(line > mf.data + t.begin && line[-1] != '\n') --line;
+        const char *nl = static_cast<const char*>(memchr(hit, '\n', end - hit));
+        const char *line_end = nl ? nl : end;
+        if(LineMatches(line, line_end - line, opt)) {
+            ++matches;
+            if(!opt.count_only) {
+                out->append(mf.name);
+                out->push_back(':');
+                out->append(line, line_end - line);
+                out->push_back('\n');
+            }
+        }
+        p = nl ? nl + 1 : end; // 一行只输出一次
+    }
+    return matches;
+}
+
+static int LevelOf(const std::string &s) {
+    for(int lv = 0; lv < 5; lv++) {
+        if(s == kLevelNames[lv]) return lv;
+    }
+    if(s == "WARN") return 2;
+    return -1;
+}
+
+int main(int argc, char *argv[]) {
+    Options opt;
+    int c;
+    while((c = getopt(argc, argv, "l:n:s:u:j:c")) != -1) {
+        switch(c) {
+            case 'l': opt.level = LevelOf(optarg); break;
+            case 'n': opt.logger = optarg; break;
+            case 's': opt.since = atoll(optarg); break;
+            case 'u': opt.until = atoll(optarg); break;
+            case 'j': opt.threads = atoi(optarg); break;
+            case 'c': opt.count_only = true; break;
+            default:
+                std::cerr << "usage: " << argv[0] << " [-l level] [-n logger] [-s since] [-u until] [-j threads] [-c] pattern file..." << std::endl;
+                return 2;
+        }
+    }
+    if(optind + 2 > argc) {
+        std::cerr << "usage: " << argv[0] << " [-l level] [-n logger] [-s since] [-u until] [-j threads] [-c] pattern file..." << std::endl;
+        return 2;
+    }
+    opt.pattern = argv[optind++];
+    for(; optind < argc; optind++) {
+        std::string name = argv[optind];
+        if(name.size() > 4 && name.compare(name.size() - 4, 4, ".idx") == 0) continue; // 通配符带进来的索引文件
+        opt.files.push_back(name);
+    }
+    if(opt.threads == 0) opt.threads = 1;
+
+    // 模式串中间完整的单词才能用布隆过滤器判断，首尾的单词可能只是更长单词的一部分
+    std::vector<std::string> tokens;
+    ForEachToken(opt.pattern.data(), opt.pattern.size(), true, [&](const char *t, size_t n) {
+        tokens.emplace_back(t, n);
+    });
+
+    std::vector<MappedFile> files(opt.files.size());
+    std::vector<Task> tasks;
+    size_t total_blocks = 0, skipped_blocks = 0;
+    for(size_t i = 0; i < opt.files.size(); i++) {
+        if(!MapFile(opt.files[i], &files[i]) || files[i].size == 0) continue;
+        std::vector<BlockEntry> blocks;
+        if(!LoadIndex(opt.files[i], &blocks)) {
+            SplitRange(i, files[i], 0, files[i].size, &tasks);
+            continue;
+        }
+        size_t indexed = 0;
+        for(auto &b : blocks) {
+            ++total_blocks;
+            // 块之前没有被索引覆盖的部分(如旧版本追加打开已有文件时留下的开头)直接扫描
+            if(b.offset > indexed && indexed < files[i].size) {
+                SplitRange(i, files[i], indexed, std::min<size_t>(files[i].size, b.offset), &tasks);
+            }
+            indexed = std::max<size_t>(indexed, b.offset + b.length);
+            if(b.offset >= files[i].size) continue;
+            if(!BlockMayMatch(b, opt, tokens)) {
+                ++skipped_blocks;
+                continue;
+            }
+            SplitRange(i, files[i], b.offset, std::min<size_t>(files[i].size, b.offset + b.length), &tasks);
+        }
+        // 正在写的文件末尾可能还没有建立索引
+        if(indexed < files[i].size) SplitRange(i, files[i], indexed, files[i].size, &tasks);
+    }
+
+    // 多线程扫描，结果按任务顺序输出
+    std::vector<std::string> results(tasks.size());
+    std::vector<char> done(tasks.size(), 0);
+    std::atomic<size_t> next_task(0);
+    std::atomic<size_t> matches(0);
+    std::atomic<size_t> scanned(0);
+    std::mutex out_mtx;
+    size_t next_print = 0;
+    std::vector<std::thread> workers;
+    for(size_t w = 0; w < std::min(opt.threads, std::max<size_t>(tasks.size(), 1)); w++) {
+        workers.emplace_back([&]() {
+            size_t i;
+            while((i = next_task.fetch_add(1)) < tasks.size()) {
+                std::string out;
+                matches += Scan(files[tasks[i].file], tasks[i], opt, &out);
+                scanned += tasks[i].end - tasks[i].begin;
+                std::unique_lock<std::mutex> lock(out_mtx);
+                results[i].swap(out);
+                done[i] = 1;
+                while(next_print < tasks.size() && done[next_print]) {
+                    fwrite(results[next_print].data(), 1, results[next_print].size(), stdout);
+                    std::string().swap(results[next_print]);
+                    ++next_print;
+                }
+            }
+        });
+    }
+    for(auto &t : workers) t.join();
+
+    if(opt.count_only) std::cout << matches << std::endl;
+    std::cerr << "blocks: " << total_blocks << " indexed, " << skipped_blocks << " skipped; "
+              << scanned << " bytes scanned" << std::endl;
+    for(auto &f : files) {
+        if(f.data) munmap(const_cast<char*>(f.data), f.size);
+    }
+    return matches > 0 ? 0 : 1;
+}
@@ -0,0 +1,170 @@
+// 日志检索对比工具：用RollFileFlush(with_index=true)生成指定大小的日志语料，格式与Message::format一致，
+// 其中夹杂多行消息的后续行、消息里带"[ERROR]["等字样的行；然后对一组模式串分别运行log_search -c和grep -F -c，
+// 比较耗时，并检查两者统计的命中行数完全相同，任何一个模式串不同都返回1。
+// 语料目录中已有*.log时直接复用(-r重新生成)。需要先编译好log_search。
+// 编译: g++ -O2 -std=c++11 log_search_bench.cpp -I../logs_code -I/usr/include/jsoncpp -ljsoncpp -pthread -o log_search_bench
+// 用法: log_search_bench [-d 语料目录] [-g 语料GB数] [-r] [-b log_search路径] [-j 线程数] [模式串...]
+#include <iostream>
+#include <string>
+#include <vector>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <unistd.h>
+#include <glob.h>
+#include "logFlush.hpp"
+
+mylog::Util::JsonData *g_conf_data;
+
+struct Options {
+    std::string dir = "/tmp/log_search_corpus";
+    double gigabytes = 2;
+    bool regenerate = false;
+    std::string search = "./log_search";
+    int threads = 0;
+    std::vector<std::string> patterns;
+};
+
+static std::vector<std::string> ListLogs(const std::string &dir) {
+    std::vector<std::string> files;
+    glob_t g;
+    if(glob((dir + "/*.log").c_str(), 0, NULL, &g) == 0) {
+        for(size_t i = 0; i < g.gl_pathc; i++) files.push_back(g.gl_pathv[i]);
+    }
+    globfree(&g);
+    return files;
+}
+
+// 按Message::format的格式生成日志，约每40行有一条带三行调用栈的消息，约每100行有一条消息里夹带等级标签
+static void Generate(const Options &opt) {
+    static const char *const levels[] = {"DEBUG", "INFO", "WARM", "ERROR", "FATAL"};
+    static const int level_weights[] = {40, 45, 10, 4, 1}; // 百分比
+    static const char *const loggers[] = {"root", "upload", "db-pool", "access.audit"};
+    static const char *const files[] = {"upload_handler.cpp:42", "session.cpp:118", "db_pool.cpp:77", "main.cpp:9"};
+    size_t target = static_cast<size_t>(opt.gigabytes * 1024 * 1024 * 1024);
+    mylog::RollFileFlush flush(opt.dir + "/corpus-", 256 * 1024 * 1024, true);
+    std::string chunk;
+    char line[512];
+    uint64_t rnd = 88172645463325252ULL;
+    size_t written = 0, lines = 0;
+    int64_t us = 8 * 3600 * 1000000LL;
+    while(written < target) {
+        chunk.clear();
+        while(chunk.size() < 1024 * 1024) {
+            rnd ^= rnd << 13;
+            rnd ^= rnd >> 7;
+            rnd ^= rnd << 17;
+            us += rnd % 300;
+            int pick = static_cast<int>(rnd % 100), lv = 0;
+            while(pick >= level_weights[lv]) pick -= level_weights[lv++];
+            unsigned tid = 139872000 + static_cast<unsigned>((rnd >> 20) % 8);
+            int64_t sec = us / 1000000;
+            int n = snprintf(line, sizeof(line), "[%02d:%02d:%02d.%06d][%u[%s][%s][%s]\t",
+                             static_cast<int>(sec / 3600 % 24), static_cast<int>(sec / 60 % 60),
+                             static_cast<int>(sec % 60), static_cast<int>(us % 1000000), tid, levels[lv],
+                             loggers[(rnd >> 8) % 4], files[(rnd >> 12) % 4]);
+            chunk.append(line, n);
+            unsigned id = static_cast<unsigned>((rnd >> 24) % 100000);
+            switch((rnd >> 40) % 100) {
+                case 0: case 1: case 2:
+                    n = snprintf(line, sizeof(line), "request_id=%u failed: timeout\n    at frame_%u upload()\n"
+                                 "    at frame_%u dispatch()\n    at frame_%u main()\n", id, id % 10, id % 7, id % 5);
+                    break;
+                case 3:
+                    n = snprintf(line, sizeof(line), "upstream replied \"[ERROR][%s] retry\" request_id=%u\n",
+                                 loggers[id % 4], id);
+                    break;
+                default:
+                    n = snprintf(line, sizeof(line), "request_id=%u user=u%u bytes=%u latency_us=%u status=%d\n",
+                                 id, id % 977, id * 7 % 65536, id % 5000, (id % 50) ? 200 : 503);
+                    break;
+            }
+            chunk.append(line, n);
+            ++lines;
+        }
+        flush.Flush(chunk.data(), chunk.size());
+        written += chunk.size();
+    }
+    printf("generated %.2f GB, %zu records\n", written / 1073741824.0, lines);
+}
+
+static std::string Quote(const std::string &s) {
+    std::string q = "'";
+    for(char c : s) {
+        if(c == '\'') q += "'\\''"; else q += c;
+    }
+    return q + "'";
+}
+
+// 运行命令，返回标准输出中各行数字之和(grep -c每个文件一行；log_search -c只有一行)，耗时写入secs
+static long long RunCount(const std::string &cmd, double *secs) {
+    auto t0 = std::chrono::steady_clock::now();
+    FILE *p = popen(cmd.c_str(), "r");
+    if(p == NULL) {
+        perror("popen");
+        return -1;
+    }
+    long long sum = 0;
+    char buf[256];
+    while(fgets(buf, sizeof(buf), p)) sum += atoll(buf);
+    pclose(p);
+    *secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+    return sum;
+}
+
+int main(int argc, char *argv[]) {
+    Options opt;
+    int c;
+    while((c = getopt(argc, argv, "d:g:rb:j:")) != -1) {
+        switch(c) {
+            case 'd': opt.dir = optarg; break;
+            case 'g': opt.gigabytes = atof(optarg); break;
+            case 'r': opt.regenerate = true; break;
+            case 'b': opt.search = optarg; break;
+            case 'j': opt.threads = atoi(optarg); break;
+            default:
+                std::cerr << "usage: " << argv[0] << " [-d dir] [-g gigabytes] [-r] [-b log_search] [-j threads] [pattern...]" << std::endl;
+                return 2;
+        }
+    }
+    for(; optind < argc; optind++) opt.patterns.push_back(argv[optind]);
+    if(opt.patterns.empty()) {
+        opt.patterns = {"[ERROR][", "upload_handler.cpp:42]", "[db-pool][", "request_id=4242 ", "at frame_3 ",
+                        "status=503", "[WARM][access.audit]", "no_such_token_anywhere"};
+    }
+    mylog::Util::JsonData::SetConfigPath("../logs_code/config.conf");
+    g_conf_data = mylog::Util::JsonData::GetJsonData();
+    mylog::Util::Config conf = g_conf_data->Current();
+    conf.flush_log = 0;
+    g_conf_data->Publish(conf);
+
+    if(opt.regenerate || ListLogs(opt.dir).empty()) {
+        if(system(("rm -f " + Quote(opt.dir) + "/*.log " + Quote(opt.dir) + "/*.log.idx").c_str()) != 0) return 1;
+        Generate(opt);
+    }
+    std::vector<std::string> logs = ListLogs(opt.dir);
+    std::string files;
+    for(auto &f : logs) files += " " + Quote(f);
+    // 先把语料读进页缓存，两边都在热缓存上比较
+    if(system(("cat" + files + " > /dev/null").c_str()) != 0) return 1;
+
+    std::string search = Quote(opt.search) + " -c" + (opt.threads > 0 ? " -j " + std::to_string(opt.threads) : "");
+    int mismatches = 0;
+    printf("%-28s %12s %12s %9s %9s\n", "pattern", "grep", "log_search", "grep s", "search s");
+    for(auto &pat : opt.patterns) {
+        double grep_secs, search_secs;
+        long long expect = RunCount("LC_ALL=C grep -F -c -h -- " + Quote(pat) + files, &grep_secs);
+        long long got = RunCount(search + " " + Quote(pat) + files + " 2>/dev/null", &search_secs);
+        bool ok = expect == got && expect >= 0;
+        if(!ok) ++mismatches;
+        printf("%-28s %12lld %12lld %9.2f %9.2f%s\n", pat.c_str(), expect, got, grep_secs, search_secs,
+               ok ? "" : "  MISMATCH");
+        fflush(stdout);
+    }
+    if(mismatches) {
+        std::cerr << mismatches << " pattern(s) differ from grep" << std::endl;
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,162 @@
+// 日志器查找压测工具：多个线程在固定时间内反复按名字获取日志器，比较加锁查找(改为写时复制之前的做法)、
+// LoggerManager::GetLogger(线程私有快照)和LoggerHandle(线程私有句柄)的吞吐。
+// 可以让一个写线程周期性地添加、删除日志器，观察注册表变化对查找的影响。
+// 编译: g++ -O2 -std=c++11 logger_lookup_bench.cpp -I../logs_code -I/usr/include/jsoncpp -ljsoncpp -pthread -o logger_lookup_bench
+// 用法: logger_lookup_bench [-t 线程数列表,如1,2,4,8] [-s 每项秒数] [-n 注册的日志器数] [-w 写线程间隔微秒,0表示不写]
+#include <iostream>
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <unordered_map>
+#include <cstdio>
+#include <cstdlib>
+#include <unistd.h>
+#include "Mylog.hpp"
+
+mylog::Util::JsonData *g_conf_data;
+ThreadPool *tp;
+
+// 改为写时复制之前的注册表：查找和修改都持有同一把互斥锁
+class MutexRegistry {
+    public:
+        void Add(const mylog::AsyncLogger::ptr &logger) {
+            std::unique_lock<std::mutex> lock(mtx_);
+            loggers_.insert(std::make_pair(logger->Name(), logger));
+        }
+        void Remove(const std::string &name) {
+            std::unique_lock<std::mutex> lock(mtx_);
+            loggers_.erase(name);
+        }
+        mylog::AsyncLogger::ptr Get(const std::string &name) {
+            std::unique_lock<std::mutex> lock(mtx_);
+            auto it = loggers_.find(name);
+            if(it == loggers_.end()) return mylog::AsyncLogger::ptr();
+            return it->second;
+        }
+    private:
+        std::mutex mtx_;
+        std::unordered_map<std::string, mylog::AsyncLogger::ptr> loggers_;
+};
+
+static std::vector<size_t> ParseList(const char *s) {
+    std::vector<size_t> v;
+    while(*s) {
+        char *end;
+        v.push_back(strtoul(s, &end, 10));
+        s = (*end == ',') ? end + 1 : end;
+        if(end == s && *s) break;
+    }
+    return v;
+}
+
+static mylog::AsyncLogger::ptr MakeLogger(const std::string &name) {
+    mylog::LoggerBuilder builder;
+    builder.BuildLoggerName(name);
+    return builder.Build();
+}
+
+// threads个线程运行seconds秒，每个线程循环调用fn(线程下标)，返回每秒总调用次数；
+// writer不为空时另起一个线程每隔interval_us调用一次
+template <typename Fn, typename Writer>
+static double Run(size_t threads, int seconds, Fn fn, int interval_us, Writer writer) {
+    std::atomic<bool> stop(false);
+    std::atomic<size_t> total(0);
+    std::vector<std::thread> ths;
+    for(size_t t = 0; t < threads; t++) {
+        ths.emplace_back([&, t]() {
+            size_t n = 0;
+            while(!stop.load(std::memory_order_relaxed)) {
+                for(int i = 0; i < 64; i++) fn(t);
+                n += 64;
+            }
+            total += n;
+        });
+    }
+    std::thread w;
+    if(interval_us > 0) {
+        w = std::thread([&]() {
+            while(!stop.load(std::memory_order_relaxed)) {
+                writer();
+                std::this_thread::sleep_for(std::chrono::microseconds(interval_us));
+            }
+        });
+    }
+    auto t0 = std::chrono::steady_clock::now();
+    std::this_thread::sleep_for(std::chrono::seconds(seconds));
+    stop = true;
+    for(auto &th : ths) th.join();
+    if(w.joinable()) w.join();
+    double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+    return total / secs;
+}
+
+int main(int argc, char *argv[]) {
+    std::vector<size_t> threads{1, 2, 4, 8};
+    int seconds = 2, interval_us = 0;
+    size_t count = 16;
+    int c;
+    while((c = getopt(argc, argv, "t:s:n:w:")) != -1) {
+        switch(c) {
+            case 't': threads = ParseList(optarg); break;
+            case 's': seconds = atoi(optarg); break;
+            case 'n': count = atoi(optarg); break;
+            case 'w': interval_us = atoi(optarg); break;
+            default:
+                std::cerr << "usage: " << argv[0] << " [-t threads,...] [-s seconds] [-n loggers] [-w writer_interval_us]" << std::endl;
+                return 2;
+        }
+    }
+    if(count == 0) count = 1;
+    mylog::Util::JsonData::SetConfigPath("../logs_code/config.conf");
+    g_conf_data = mylog::Util::JsonData::GetJsonData();
+
+    MutexRegistry registry;
+    std::vector<std::string> names;
+    for(size_t i = 0; i < count; i++) {
+        names.push_back("bench" + std::to_string(i));
+        mylog::AsyncLogger::ptr logger = MakeLogger(names.back());
+        registry.Add(logger);
+        mylog::LoggerManager::GetInstance().AddLogger(std::move(logger));
+    }
+    // 写线程反复添加、删除同一个日志器，只改变注册表，不影响被查找的日志器
+    mylog::AsyncLogger::ptr churn = MakeLogger("churn");
+    bool present = false;
+    auto mutex_writer = [&]() {
+        if(present) registry.Remove("churn"); else registry.Add(churn);
+        present = !present;
+    };
+    auto cow_writer = [&]() {
+        mylog::LoggerManager &mgr = mylog::LoggerManager::GetInstance();
+        if(present) mgr.RemoveLogger("churn"); else mgr.AddLogger(mylog::AsyncLogger::ptr(churn));
+        present = !present;
+    };
+
+    printf("%-8s %16s %16s %16s\n", "threads", "mutex (ops/s)", "GetLogger", "LoggerHandle");
+    for(size_t t : threads) {
+        double mutex_ops = Run(t, seconds, [&](size_t id) {
+            mylog::AsyncLogger::ptr logger = registry.Get(names[id % names.size()]);
+            if(!logger) abort();
+        }, interval_us, mutex_writer);
+        present = false;
+        registry.Remove("churn");
+        double cow_ops = Run(t, seconds, [&](size_t id) {
+            mylog::AsyncLogger::ptr logger = mylog::LoggerManager::GetInstance().GetLogger(names[id % names.size()]);
+            if(!logger) abort();
+        }, interval_us, cow_writer);
+        present = false;
+        mylog::LoggerManager::GetInstance().RemoveLogger("churn");
+        // 每个线程一个句柄，与static thread_local的用法相同
+        std::vector<std::unique_ptr<mylog::LoggerHandle>> handles;
+        for(size_t i = 0; i < t; i++) handles.emplace_back(new mylog::LoggerHandle(names[i % names.size()]));
+        double handle_ops = Run(t, seconds, [&](size_t id) {
+            if(!handles[id]->Get()) abort();
+        }, interval_us, cow_writer);
+        present = false;
+        mylog::LoggerManager::GetInstance().RemoveLogger("churn");
+        printf("%-8zu %16.0f %16.0f %16.0f\n", t, mutex_ops, cow_ops, handle_ops);
+    }
+    return 0;
+}
@@ -0,0 +1,252 @@
+// NetFlush的回环替身接收端：按NetBatchHeader读取批次，压缩的批次解压校验长度，按序号去重并回复确认，
+// 每秒打印一次接收速率。用于在本机测量网络落地方向的吞吐，以及断线重连、重放的表现。
+// 默认在同一进程内再起一个发送线程，用NetFlush在固定时间内持续发送，结束时打印NetFlushStats；
+// -l只运行接收端，等待外部进程的NetFlush连接。
+// -r N让接收端每收到N个批次就不回确认直接断开，制造重连和重放。
+// 编译: g++ -O2 -std=c++11 net_log_receiver.cpp -I../logs_code -I/usr/include/jsoncpp -ljsoncpp -lz -pthread -o net_log_receiver
+// 用法: net_log_receiver [-p 端口 | -u unix套接字路径] [-l] [-o 输出文件] [-r 断开间隔批次数]
+//                        [-t 发送秒数] [-b 每批字节数] [-z 压缩]
+#include <iostream>
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <ctime>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <cerrno>
+#include <unistd.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <netinet/in.h>
+#include <arpa/inet.h>
+#include <zlib.h>
+#include "NetFlush.hpp"
+
+mylog::Util::JsonData *g_conf_data;
+
+struct Options {
+    uint16_t port = 19000;
+    std::string unix_path;
+    bool listen_only = false;
+    std::string output;
+    size_t drop_every = 0;
+    int seconds = 3;
+    size_t batch_bytes = 64 * 1024;
+    bool compress = false;
+};
+
+struct ReceiverStats {
+    std::atomic<uint64_t> batches{0}; // 去重后的批次
+    std::atomic<uint64_t> raw_bytes{0}; // 去重后的日志字节数(解压后)
+    std::atomic<uint64_t> wire_bytes{0}; // 线上收到的字节数(含重发)
+    std::atomic<uint64_t> duplicates{0}; // 重发的、已经收到过的批次
+    std::atomic<uint64_t> connections{0};
+    std::atomic<uint64_t> errors{0}; // 格式或解压错误
+};
+
+static bool ReadFull(int fd, void *buf, size_t len) {
+    char *p = static_cast<char*>(buf);
+    while(len > 0) {
+        ssize_t n = recv(fd, p, len, 0);
+        if(n < 0 && errno == EINTR) continue;
+        if(n <= 0) return false;
+        p += n;
+        len -= n;
+    }
+    return true;
+}
+
+// 处理一条连接，直到对端断开、出错或者达到断开间隔；last_seq跨连接保留，用于去重
+static void Serve(int fd, const Options &opt, FILE *out, uint64_t *last_seq, ReceiverStats *st) {
+    std::string data, raw;
+    size_t received = 0;
+    while(true) {
+        mylog::NetBatchHeader h;
+        if(!ReadFull(fd, &h, sizeof(h))) break;
+        if(ntohl(h.magic) != mylog::NetFlush::kMagic) {
+            std::cerr << "bad magic, closing connection" << std::endl;
+            ++st->errors;
+            break;
+        }
+        uint64_t seq = be64toh(h.seq);
+        uint32_t len = ntohl(h.length), raw_len = ntohl(h.raw_length);
+        data.resize(len);
+        if(len > 0 && !ReadFull(fd, &data[0], len)) break;
+        st->wire_bytes += sizeof(h) + len;
+        if(opt.drop_every > 0 && ++received % opt.drop_every == 0) {
+            break; // 不确认这一批就断开，发送端重连后应当从这一批开始重发
+        }
+        if(seq <= *last_seq) {
+            ++st->duplicates;
+        } else {
+            const std::string *body = &data;
+            if(ntohl(h.flags) & mylog::NetFlush::kFlagCompressed) {
+                raw.resize(raw_len);
+                uLongf dest_len = raw_len;
+                if(uncompress(reinterpret_cast<Bytef*>(&raw[0]), &dest_len,
+                              reinterpret_cast<const Bytef*>(data.data()), len) != Z_OK || dest_len != raw_len) {
+                    std::cerr << "inflate batch " << seq << " failed" << std::endl;
+                    ++st->errors;
+                    break;
+                }
+                body = &raw;
+            } else if(len != raw_len) {
+                ++st->errors;
+            }
+            if(seq != *last_seq + 1) {
+                std::cerr << "gap: expected batch " << *last_seq + 1 << ", got " << seq << std::endl;
+            }
+            if(out) fwrite(body->data(), 1, body->size(), out);
+            *last_seq = seq;
+            ++st->batches;
+            st->raw_bytes += body->size();
+        }
+        uint64_t ack = htobe64(*last_seq);
+        if(send(fd, &ack, sizeof(ack), MSG_NOSIGNAL) != sizeof(ack)) break;
+    }
+    close(fd);
+}
+
+static int Listen(const Options &opt) {
+    int fd;
+    if(!opt.unix_path.empty()) {
+        fd = socket(AF_UNIX, SOCK_STREAM, 0);
+        struct sockaddr_un addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        strncpy(addr.sun_path, opt.unix_path.c_str(), sizeof(addr.sun_path) - 1);
+        unlink(opt.unix_path.c_str());
+        if(bind(fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) < 0) {
+            perror("bind");
+            return -1;
+        }
+    } else {
+        fd = socket(AF_INET, SOCK_STREAM, 0);
+        int on = 1;
+        setsockopt(fd, SOL_SOCKET, SO_REUSEADDR, &on, sizeof(on));
+        struct sockaddr_in addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.sin_family = AF_INET;
+        addr.sin_port = htons(opt.port);
+        inet_aton("127.0.0.1", &addr.sin_addr);
+        if(bind(fd, reinterpret_cast<struct sockaddr*>(&addr), sizeof(addr)) < 0) {
+            perror("bind");
+            return -1;
+        }
+    }
+    if(listen(fd, 16) < 0) {
+        perror("listen");
+        return -1;
+    }
+    return fd;
+}
+
+// 发送端：反复把一批日志行交给NetFlush，与异步线程调用落地方向的方式相同
+static void Sender(const Options &opt, std::atomic<bool> *stop, mylog::NetFlushStats *result, double *cpu_secs) {
+    mylog::NetFlush::ptr flush;
+    if(!opt.unix_path.empty()) {
+        flush = std::make_shared<mylog::NetFlush>(mylog::NetFlush::Unix(), opt.unix_path, opt.compress);
+    } else {
+        flush = std::make_shared<mylog::NetFlush>(mylog::NetFlush::Tcp(), "127.0.0.1", opt.port, opt.compress);
+    }
+    std::string batch;
+    for(size_t i = 0; batch.size() < opt.batch_bytes; i++) {
+        batch += "[12:00:00][140000000000][INFO][bench][net_log_receiver.cpp:1]\trequest " +
+                 std::to_string(i) + " served in 120us\n";
+    }
+    struct timespec t0, t1;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &t0);
+    while(!stop->load(std::memory_order_relaxed)) {
+        flush->Flush(batch.data(), batch.size());
+    }
+    flush->Sync();
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &t1);
+    *result = flush->Stats();
+    *cpu_secs = (t1.tv_sec - t0.tv_sec) + (t1.tv_nsec - t0.tv_nsec) / 1e9;
+}
+
+int main(int argc, char *argv[]) {
+    Options opt;
+    int c;
+    while((c = getopt(argc, argv, "p:u:lo:r:t:b:z")) != -1) {
+        switch(c) {
+            case 'p': opt.port = atoi(optarg); break;
+            case 'u': opt.unix_path = optarg; break;
+            case 'l': opt.listen_only = true; break;
+            case 'o': opt.output = optarg; break;
+            case 'r': opt.drop_every = atoi(optarg); break;
+            case 't': opt.seconds = atoi(optarg); break;
+            case 'b': opt.batch_bytes = atoi(optarg); break;
+            case 'z': opt.compress = true; break;
+            default:
+                std::cerr << "usage: " << argv[0] << " [-p port | -u unix_path] [-l] [-o output] [-r drop_every]"
+                          << " [-t seconds] [-b batch_bytes] [-z]" << std::endl;
+                return 2;
+        }
+    }
+    int lfd = Listen(opt);
+    if(lfd < 0) return 1;
+    FILE *out = NULL;
+    if(!opt.output.empty()) {
+        out = fopen(opt.output.c_str(), "wb");
+        if(out == NULL) {
+            perror(opt.output.c_str());
+            return 1;
+        }
+    }
+
+    // 接收端一次服务一条连接，NetFlush只维持一条长连接
+    ReceiverStats st;
+    std::thread receiver([&]() {
+        uint64_t last_seq = 0;
+        while(true) {
+            int fd = accept(lfd, NULL, NULL);
+            if(fd < 0) {
+                if(errno == EINTR) continue;
+                break; // 监听套接字被关闭
+            }
+            ++st.connections;
+            Serve(fd, opt, out, &last_seq, &st);
+        }
+    });
+
+    std::atomic<bool> stop(false);
+    mylog::NetFlushStats sent;
+    double sender_cpu = 0;
+    std::thread sender;
+    if(!opt.listen_only) sender = std::thread(Sender, std::cref(opt), &stop, &sent, &sender_cpu);
+
+    auto t0 = std::chrono::steady_clock::now();
+    uint64_t prev_raw = 0, prev_batches = 0;
+    for(int sec = 1; opt.listen_only || sec <= opt.seconds; sec++) {
+        std::this_thread::sleep_for(std::chrono::seconds(1));
+        uint64_t raw = st.raw_bytes, batches = st.batches;
+        printf("%3ds: %8.1f MB/s, %8lu batches/s, %lu connections, %lu duplicates\n", sec,
+               (raw - prev_raw) / 1048576.0, (unsigned long)(batches - prev_batches),
+               (unsigned long)st.connections.load(), (unsigned long)st.duplicates.load());
+        fflush(stdout);
+        prev_raw = raw;
+        prev_batches = batches;
+    }
+    double secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+    stop = true;
+    if(sender.joinable()) sender.join();
+    shutdown(lfd, SHUT_RDWR);
+    close(lfd);
+    receiver.join();
+    if(out) fclose(out);
+    if(!opt.unix_path.empty()) unlink(opt.unix_path.c_str());
+
+    printf("received: %lu batches, %.1f MB (%.1f MB/s), %.1f MB on the wire, %lu duplicates, %lu errors\n",
+           (unsigned long)st.batches.load(), st.raw_bytes / 1048576.0, st.raw_bytes / 1048576.0 / secs,
+           st.wire_bytes / 1048576.0, (unsigned long)st.duplicates.load(), (unsigned long)st.errors.load());
+    printf("sent: %lu batches, %.1f MB, %lu replayed, %lu dropped, %lu connects, %.1f MB copied for replay, "
+           "sender CPU %.1f ms/GB\n",
+           (unsigned long)sent.batches, sent.bytes / 1048576.0, (unsigned long)sent.replayed,
+           (unsigned long)sent.dropped, (unsigned long)sent.reconnects, sent.copied / 1048576.0,
+           sent.bytes ? sender_cpu * 1000 / (sent.bytes / 1073741824.0) : 0.0);
+    return 0;
+}
@@ -0,0 +1,194 @@
+// 有序输出压测工具：每个节点一个分片的日志器，比较UNORDERED、STRICT、BOUNDED三种输出顺序的代价。
+// 分别统计生产者每条日志的CPU时间(序号在分片锁内分配、记录头)和异步线程每条日志的CPU时间(k路归并)，
+// 并检查每个生产者自己的日志在输出中是否保持写入顺序。
+// 之后每种模式再做一次校验：生产者在同一把锁内取全局编号并写入日志，日志器的序号也在这期间分配，
+// 所以全局编号的顺序就是归并使用的序号顺序。检查STRICT输出的全局编号严格递增，BOUNDED输出中
+// 每条记录落后于此前输出的最大编号不超过窗口；记录缺失或违反时返回1。
+// 单节点机器上需要用MYLOG_TOPOLOGY模拟多节点，如MYLOG_TOPOLOGY="0;0" order_bench，只有一个分片时不做归并。
+// 编译: g++ -O2 -std=c++11 order_bench.cpp -I../logs_code -I/usr/include/jsoncpp -ljsoncpp -pthread -o order_bench
+// 用法: order_bench [-t 线程数] [-n 每个线程的记录数] [-w BOUNDED窗口] [-c 校验时每个线程的记录数]
+#include <iostream>
+#include <string>
+#include <vector>
+#include <thread>
+#include <chrono>
+#include <mutex>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <algorithm>
+#include <ctime>
+#include <unistd.h>
+#include <sys/time.h>
+#include <sys/resource.h>
+#include "Mylog.hpp"
+
+mylog::Util::JsonData *g_conf_data;
+ThreadPool *tp;
+
+// 解析输出中的"producer <t> record <i> global <g>"，统计每个生产者的记录出现逆序的次数，
+// 以及全局编号的逆序次数和最大落后量(此前输出的最大编号减去本条编号)；由日志器的锁串行化调用
+class CheckFlush : public mylog::LogFlush {
+    public:
+        explicit CheckFlush(size_t threads) : last_(threads, -1) {}
+        void Flush(const char *data, size_t len) override {
+            Scan(data, len);
+        }
+        void Flush(const struct iovec *iov, int iovcnt) override {
+            for(int i = 0; i < iovcnt; i++) Scan(static_cast<const char*>(iov[i].iov_base), iov[i].iov_len);
+        }
+        size_t records = 0;
+        size_t inversions = 0;
+        size_t global_inversions = 0;
+        uint64_t max_lag = 0;
+    private:
+        // 未分片时iovec按内存段切分，一行可能跨越两段，不完整的行留到下一段拼接
+        void Scan(const char *data, size_t len) {
+            pending_.append(data, len);
+            size_t done = pending_.rfind('\n');
+            if(done == std::string::npos) return;
+            const char *p = pending_.c_str();
+            const char *end = p + done + 1;
+            const char *tag = "producer ";
+            size_t tag_len = strlen(tag);
+            while(p < end) {
+                const char *hit = static_cast<const char*>(memmem(p, end - p, tag, tag_len));
+                if(hit == nullptr) break;
+                char *q;
+                size_t t = strtoul(hit + tag_len, &q, 10);
+                long i = strtol(q + strlen(" record "), &q, 10);
+                if(t < last_.size()) {
+                    if(i < last_[t]) ++inversions;
+                    last_[t] = i;
+                }
+                if(strncmp(q, " global ", strlen(" global ")) == 0) {
+                    uint64_t g = strtoull(q + strlen(" global "), &q, 10);
+                    if(records > 0 && g <= max_global_) {
+                        ++global_inversions;
+                        max_lag = std::max<uint64_t>(max_lag, max_global_ - g);
+                    }
+                    max_global_ = std::max(max_global_, g);
+                }
+                ++records;
+                p = q;
+            }
+            pending_.erase(0, done + 1);
+        }
+        std::string pending_;
+        std::vector<long> last_;
+        uint64_t max_global_ = 0;
+};
+
+static double ThreadCpuNs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+static double ProcessCpuNs() {
+    struct rusage ru;
+    getrusage(RUSAGE_SELF, &ru);
+    return (ru.ru_utime.tv_sec + ru.ru_stime.tv_sec) * 1e9 + (ru.ru_utime.tv_usec + ru.ru_stime.tv_usec) * 1e3;
+}
+
+// numbered为true时生产者在g_number_mtx内取全局编号并写日志，用于校验输出顺序，耗时没有参考意义
+static std::shared_ptr<CheckFlush> RunCase(const char *label, mylog::OrderType order, size_t window,
+                                           size_t threads, size_t n, bool numbered) {
+    auto sink = std::make_shared<CheckFlush>(threads);
+    double producer_ns = 0, total_ns, secs;
+    {
+        std::vector<mylog::LogFlush::ptr> flushs{sink};
+        mylog::AsyncLogger::ptr logger = std::make_shared<mylog::AsyncLogger>(
+            label, flushs, mylog::AsyncType::ASYNC_UNSAFE, mylog::Topology::kPerNode, order, window);
+        std::mutex number_mtx;
+        unsigned long long number = 0;
+        std::vector<std::thread> ths;
+        std::vector<double> cpu(threads);
+        double cpu0 = ProcessCpuNs();
+        auto t0 = std::chrono::steady_clock::now();
+        for(size_t t = 0; t < threads; t++) {
+            ths.emplace_back([&, t]() {
+                double start = ThreadCpuNs();
+                for(size_t i = 0; i < n; i++) {
+                    if(numbered) {
+                        std::unique_lock<std::mutex> lock(number_mtx);
+                        logger->Info("producer %zu record %zu global %llu", t, i, number++);
+                    } else {
+                        logger->Info("producer %zu record %zu", t, i);
+                    }
+                }
+                cpu[t] = ThreadCpuNs() - start;
+            });
+        }
+        for(auto &th : ths) th.join();
+        logger->Stop(mylog::AsyncWorker::Clock::time_point::max()); // 包括归并阶段剩余的记录
+        secs = std::chrono::duration<double>(std::chrono::steady_clock::now() - t0).count();
+        total_ns = ProcessCpuNs() - cpu0;
+        for(double c : cpu) producer_ns += c;
+    }
+    size_t total = threads * n;
+    if(numbered) {
+        printf("%-10s check: %zu/%zu records, %zu inversions, %zu global inversions, max lag %llu\n",
+               label, sink->records, total, sink->inversions, sink->global_inversions,
+               static_cast<unsigned long long>(sink->max_lag));
+    } else {
+        printf("%-10s %10.0f records/s  producer %7.1f ns/record  worker %7.1f ns/record  %zu/%zu records, %zu inversions\n",
+               label, total / secs, producer_ns / total, (total_ns - producer_ns) / total,
+               sink->records, total, sink->inversions);
+    }
+    return sink;
+}
+
+int main(int argc, char *argv[]) {
+    size_t threads = 4, n = 200000, window = 4096, check_n = 50000;
+    int c;
+    while((c = getopt(argc, argv, "t:n:w:c:")) != -1) {
+        switch(c) {
+            case 't': threads = atoi(optarg); break;
+            case 'n': n = atoi(optarg); break;
+            case 'w': window = atoi(optarg); break;
+            case 'c': check_n = atoi(optarg); break;
+            default:
+                std::cerr << "usage: " << argv[0] << " [-t threads] [-n records] [-w window] [-c check_records]" << std::endl;
+                return 2;
+        }
+    }
+    mylog::Util::JsonData::SetConfigPath("../logs_code/config.conf");
+    g_conf_data = mylog::Util::JsonData::GetJsonData();
+    mylog::Util::Config conf = g_conf_data->Current();
+    conf.log_level = 0;
+    g_conf_data->Publish(conf);
+    ThreadPool pool(1);
+    tp = &pool;
+
+    mylog::Topology &topo = mylog::Topology::GetInstance();
+    printf("shards=%d%s threads=%zu records=%zu window=%zu\n", topo.NodeCount(),
+           topo.Simulated() ? " (simulated)" : "", threads, threads * n, window);
+    if(topo.NodeCount() == 1) {
+        std::cerr << "only one shard, nothing is merged; set MYLOG_TOPOLOGY, e.g. MYLOG_TOPOLOGY=\"0;0\"" << std::endl;
+    }
+    int failed = 0;
+    auto check = [&](const std::shared_ptr<CheckFlush> &sink, size_t total) {
+        if(sink->records != total || sink->inversions != 0) ++failed;
+    };
+    check(RunCase("unordered", mylog::OrderType::UNORDERED, window, threads, n, false), threads * n);
+    check(RunCase("strict", mylog::OrderType::STRICT, window, threads, n, false), threads * n);
+    check(RunCase("bounded", mylog::OrderType::BOUNDED, window, threads, n, false), threads * n);
+
+    size_t total = threads * check_n;
+    auto unordered = RunCase("unordered", mylog::OrderType::UNORDERED, window, threads, check_n, true);
+    check(unordered, total);
+    auto strict = RunCase("strict", mylog::OrderType::STRICT, window, threads, check_n, true);
+    check(strict, total);
+    if(strict->global_inversions != 0) {
+        std::cerr << "strict: output is not in global order" << std::endl;
+        ++failed;
+    }
+    auto bounded = RunCase("bounded", mylog::OrderType::BOUNDED, window, threads, check_n, true);
+    check(bounded, total);
+    if(bounded->max_lag > window) {
+        std::cerr << "bounded: a record lags " << bounded->max_lag << " behind, window is " << window << std::endl;
+        ++failed;
+    }
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,146 @@
+// 分片日志器压测工具：多个生产者线程写同一个日志器，比较异步线程不绑定、绑定到节点0、每个节点一个分片
+// (各分片共用一个输出流 / 每个分片一个输出流)几种放置方式的吞吐和生产者CPU时间，
+// 并统计各分片写出的批次，检查生产者是否分散到了各个分片。
+// 单节点机器上用环境变量MYLOG_TOPOLOGY模拟多节点，如MYLOG_TOPOLOGY="0;0" shard_bench。
+// 落地方向为只计数的空实现，排除磁盘的影响；-s给每次写出加上固定的延迟(模拟磁盘或网络)，
+// 共用输出流时各分片在日志器的锁上排队写出，和每个分片一个输出流对比可以看出串行写出的代价：
+// 输出中drain为生产者结束后等待剩余日志写完的时间；加上-f使用固定容量的缓冲区，写出慢时生产者被阻塞。
+// 编译: g++ -O2 -std=c++11 shard_bench.cpp -I../logs_code -I/usr/include/jsoncpp -ljsoncpp -pthread -o shard_bench
+// 用法: shard_bench [-t 线程数] [-n 每个线程的记录数] [-s 每次写出的延迟微秒] [-f]
+#include <iostream>
+#include <string>
+#include <vector>
+#include <thread>
+#include <atomic>
+#include <chrono>
+#include <mutex>
+#include <cstdio>
+#include <cstdlib>
+#include <ctime>
+#include <unistd.h>
+#include "Mylog.hpp"
+
+mylog::Util::JsonData *g_conf_data;
+ThreadPool *tp;
+
+static unsigned g_sink_us = 0; // 每次写出的延迟
+static mylog::AsyncType g_type = mylog::AsyncType::ASYNC_UNSAFE;
+
+// 只统计字节数的落地方向，同时记录每个异步线程各写出了多少次；多个分片共用时由日志器的锁串行化调用
+class CountFlush : public mylog::LogFlush {
+    public:
+        void Flush(const char *, size_t len) override {
+            bytes += len;
+            Count();
+        }
+        void Flush(const struct iovec *iov, int iovcnt) override {
+            for(int i = 0; i < iovcnt; i++) bytes += iov[i].iov_len;
+            Count();
+        }
+        // 各异步线程写出的批次数
+        std::vector<size_t> PerThread() {
+            std::unique_lock<std::mutex> lock(mtx_);
+            std::vector<size_t> v;
+            for(auto &it : batches_) v.push_back(it.second);
+            return v;
+        }
+        std::atomic<size_t> bytes{0};
+    private:
+        void Count() {
+            if(g_sink_us) usleep(g_sink_us);
+            std::unique_lock<std::mutex> lock(mtx_);
+            for(auto &it : batches_) {
+                if(it.first == std::this_thread::get_id()) {
+                    ++it.second;
+                    return;
+                }
+            }
+            batches_.push_back(std::make_pair(std::this_thread::get_id(), size_t(1)));
+        }
+        std::mutex mtx_;
+        std::vector<std::pair<std::thread::id, size_t>> batches_;
+};
+
+static double ThreadCpuNs() {
+    struct timespec ts;
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ts.tv_sec * 1e9 + ts.tv_nsec;
+}
+
+// split为true时每个分片一个CountFlush，否则所有分片共用一个
+static void RunCase(const char *label, int node, bool split, size_t threads, size_t n) {
+    std::vector<std::shared_ptr<CountFlush>> sinks{std::make_shared<CountFlush>()};
+    double cpu_ns = 0, secs, drain_ms;
+    {
+        std::vector<mylog::LogFlush::ptr> flushs{sinks[0]};
+        mylog::AsyncLogger::ShardFlushMaker shard_flush;
+        if(split) {
+            shard_flush = [&sinks](int shard) {
+                if(shard > 0) sinks.push_back(std::make_shared<CountFlush>());
+                return std::vector<mylog::LogFlush::ptr>{sinks.back()};
+            };
+        }
+        mylog::AsyncLogger::ptr logger = std::make_shared<mylog::AsyncLogger>(
+            label, flushs, g_type, node, mylog::OrderType::UNORDERED, 0, shard_flush);
+        std::vector<std::thread> ths;
+        std::vector<double> cpu(threads);
+        auto t0 = std::chrono::steady_clock::now();
+        for(size_t t = 0; t < threads; t++) {
+            ths.emplace_back([&, t]() {
+                double start = ThreadCpuNs();
+                for(size_t i = 0; i < n; i++) {
+                    logger->Info("producer %zu record %zu", t, i);
+                }
+                cpu[t] = ThreadCpuNs() - start;
+            });
+        }
+        for(auto &th : ths) th.join();
+        auto t1 = std::chrono::steady_clock::now();
+        logger->Drain(mylog::AsyncWorker::Clock::time_point::max());
+        auto t2 = std::chrono::steady_clock::now();
+        secs = std::chrono::duration<double>(t2 - t0).count();
+        drain_ms = std::chrono::duration<double, std::milli>(t2 - t1).count();
+        for(double c : cpu) cpu_ns += c;
+    }
+    size_t bytes = 0;
+    for(auto &s : sinks) bytes += s->bytes.load();
+    printf("%-14s %10.0f records/s %8.1f ns/record (producer CPU), drain %7.1f ms, %zu bytes, %zu stream(s), "
+           "batches per shard:", label, threads * n / secs, cpu_ns / (threads * n), drain_ms, bytes, sinks.size());
+    for(auto &s : sinks) {
+        for(size_t b : s->PerThread()) printf(" %zu", b);
+    }
+    printf("\n");
+}
+
+int main(int argc, char *argv[]) {
+    size_t threads = 4, n = 200000;
+    int c;
+    while((c = getopt(argc, argv, "t:n:s:f")) != -1) {
+        switch(c) {
+            case 't': threads = atoi(optarg); break;
+            case 'n': n = atoi(optarg); break;
+            case 's': g_sink_us = atoi(optarg); break;
+            case 'f': g_type = mylog::AsyncType::ASYNC_SAFE; break;
+            default:
+                std::cerr << "usage: " << argv[0] << " [-t threads] [-n records] [-s sink_delay_us] [-f]" << std::endl;
+                return 2;
+        }
+    }
+    mylog::Util::JsonData::SetConfigPath("../logs_code/config.conf");
+    g_conf_data = mylog::Util::JsonData::GetJsonData();
+    mylog::Util::Config conf = g_conf_data->Current();
+    conf.log_level = 0;
+    g_conf_data->Publish(conf);
+    ThreadPool pool(1);
+    tp = &pool;
+
+    mylog::Topology &topo = mylog::Topology::GetInstance();
+    printf("nodes=%d%s threads=%zu records=%zu sink delay=%uus%s\n", topo.NodeCount(),
+           topo.Simulated() ? " (simulated)" : "", threads, threads * n, g_sink_us,
+           g_type == mylog::AsyncType::ASYNC_SAFE ? " fixed buffers" : "");
+    RunCase("any", mylog::Topology::kAnyNode, false, threads, n);
+    RunCase("node0", 0, false, threads, n);
+    RunCase("per-node", mylog::Topology::kPerNode, false, threads, n);
+    RunCase("per-node-split", mylog::Topology::kPerNode, true, threads, n);
+    return 0;
+}